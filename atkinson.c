@@ -2,37 +2,227 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
 #include <netpbm/pam.h>
 #include <netpbm/pbm.h>
+#include <netpbm/pgm.h>
+
+#include "colorspace.h"
+#include "diffuse.h"
+#include "rawpnm.h"
+#include "stats.h"
 
 enum { R, G, B };
 typedef unsigned int uint;
+typedef unsigned short ushort;
+typedef unsigned char uchar;
 
-int
-main(int argc, char **argv)
-{
-	struct pam inpam;
-	tuple *row = NULL;
-	bit *outrow = NULL;
-	int *err = NULL;
-	int cols, width, height;
-	int x, y;
+/* Pixels dithered between progress updates in threaded mode. */
+#define CHUNK 256
 
-	(void)argc;
-	pm_init(argv[0], 0);
+/* Go through libnetpbm even for raw images, for comparison. */
+static int use_netpbm;
 
-	pnm_readpaminit(stdin, &inpam, PAM_STRUCT_SIZE(tuple_type));
-	if (inpam.depth < 3) {
-		fprintf(stderr, "input should have at least a depth of 3.\n");
+/* Number of gray levels in the output. */
+static int levels = 2;
+
+/*
+ * Rows come straight from the raw raster when possible and from
+ * libnetpbm tuples otherwise. Gray images use their one channel for
+ * red, green and blue.
+ */
+struct source {
+	struct pam *pam;
+	struct rawpnm raw;
+	int israw;
+	int chan[3];
+	tuple *row;
+	uchar *planes;
+};
+
+static void *
+xmalloc(size_t size)
+{
+	void *ptr;
+
+	ptr = malloc(size);
+	if (ptr == NULL) {
+		perror("malloc");
 		exit(1);
 	}
 
-	width = inpam.width;
-	height = inpam.height;
-	row = pnm_allocpamrow(&inpam);
+	return ptr;
+}
+
+/*
+ * Convert a row with samples above 255 the slow way.
+ */
+static void
+gray_row(const tuple *row, const int *chan, ushort *gray, int width)
+{
+	int x;
+
+	for (x = 0; x < width; ++x) {
+		gray[x] = row[x][chan[R]] * 21 / 100 +
+		    row[x][chan[G]] * 72 / 100 +
+		    row[x][chan[B]] *  7 / 100;
+	}
+}
+
+/*
+ * Split an 8-bit row into separate red, green and blue planes.
+ */
+static void
+unpack_row(const tuple *row, const int *chan, uchar *r, uchar *g, uchar *b,
+    int width)
+{
+	int x;
+
+	for (x = 0; x < width; ++x) {
+		r[x] = row[x][chan[R]];
+		g[x] = row[x][chan[G]];
+		b[x] = row[x][chan[B]];
+	}
+}
+
+/*
+ * Same for a row of packed samples.
+ */
+static void
+split_row(const uchar *p, int depth, const int *chan, uchar *r, uchar *g,
+    uchar *b, int width)
+{
+	int x;
+
+	for (x = 0; x < width; ++x) {
+		r[x] = p[chan[R]];
+		g[x] = p[chan[G]];
+		b[x] = p[chan[B]];
+		p += depth;
+	}
+}
+
+static void
+source_open(struct source *src, struct pam *pam)
+{
+	int i;
+
+	src->pam = pam;
+	src->israw = !use_netpbm && rawpnm_open(&src->raw, pam);
+	src->row = src->israw ? NULL : pnm_allocpamrow(pam);
+	src->planes = xmalloc(3 * pam->width + 1);
+
+	for (i = 0; i < 3; ++i)
+		src->chan[i] = pam->depth >= 3 ? i : 0;
+}
+
+static void
+source_close(struct source *src)
+{
+	if (src->israw)
+		rawpnm_close(&src->raw);
+	else
+		pnm_freepamrow(src->row);
+	free(src->planes);
+}
+
+/*
+ * Read the next row and convert it to luminance.
+ */
+static void
+source_gray_row(struct source *src, ushort *gray, unsigned long *clock)
+{
+	int width = src->pam->width;
+	uchar *r = src->planes;
+	uchar *g = src->planes + width;
+	uchar *b = src->planes + 2 * width;
+
+	if (src->israw) {
+		const uchar *p = rawpnm_readrow(&src->raw);
+
+		if (src->raw.depth == 1)
+			r = g = b = (uchar *)p;
+		else
+			split_row(p, src->raw.depth, src->chan, r, g, b, width);
+	} else {
+		pnm_readpamrow(src->pam, src->row);
+		if (src->pam->maxval > 255) {
+			stats_lap("read", clock);
+			gray_row(src->row, src->chan, gray, width);
+			stats_lap("luma", clock);
+			return;
+		}
+
+		unpack_row(src->row, src->chan, r, g, b, width);
+	}
+
+	stats_lap("read", clock);
+	colorspace_luma_row(r, g, b, gray, width);
+	stats_lap("luma", clock);
+}
+
+/*
+ * Scratch space for write_row(): a packed PBM row or a row of gray
+ * samples for libnetpbm.
+ */
+static uchar *
+alloc_outbuf(int width)
+{
+	return xmalloc(width * sizeof(gray) + 1);
+}
+
+static void
+write_init(int width, int height)
+{
+	if (levels > 2)
+		pgm_writepgminit(stdout, width, height, levels - 1, 0);
+	else
+		pbm_writepbminit(stdout, width, height, 0);
+}
+
+static void
+write_row(const bit *row, int width, uchar *outbuf)
+{
+	if (levels > 2) {
+		if (use_netpbm) {
+			gray *grayrow = (gray *)outbuf;
+			int x;
+
+			for (x = 0; x < width; ++x)
+				grayrow[x] = row[x];
+			pgm_writepgmrow(stdout, grayrow, width, levels - 1, 0);
+		} else
+			rawpnm_writerow(stdout, row, width);
+	} else if (use_netpbm)
+		pbm_writepbmrow(stdout, row, width, 0);
+	else
+		rawpbm_writerow(stdout, row, width, outbuf);
+}
+
+static void
+dither_serial(struct pam *inpam, const struct kernel *k, int serpentine)
+{
+	struct source src;
+	ushort *gray = NULL;
+	bit *outrow = NULL;
+	uchar *outbuf = NULL;
+	int *err = NULL;
+	int cols, width, height;
+	span_fn span;
+	unsigned long clock;
+	int y;
+
+	width = inpam->width;
+	height = inpam->height;
+	source_open(&src, inpam);
+	gray = xmalloc(width * sizeof(*gray) + 1);
+	outbuf = alloc_outbuf(width);
 
-	/* Add horizontal padding to access x-1, x+2 */
-	cols = width + 3;
+	/* Add horizontal padding to access x-2, x+2 */
+	cols = width + 2 * DIFFUSE_PAD;
 	err = calloc(3 * cols, sizeof(*err));
 	if (!err) {
 		perror("calloc");
@@ -40,53 +230,279 @@ main(int argc, char **argv)
 	}
 
 	/* Initialize PBM output */
-	pbm_writepbminit(stdout, width, height, 0);
+	write_init(width, height);
 	outrow = pbm_allocrow(width);
 
+	clock = stats_clock();
 	for (y = 0; y < height; ++y) {
 		int i0 = (y + 0) % 3;
 		int i1 = (y + 1) % 3;
 		int i2 = (y + 2) % 3;
 
-		pnm_readpamrow(&inpam, row);
+		source_gray_row(&src, gray, &clock);
 
 		/* Clear the error buffer for row y+2 */
 		memset(&err[i2 * cols], 0, cols * sizeof(*err));
 
-		for (x = 0; x < width; ++x) {
-			int Y, cv, diff, idx;
+		span = k->span[levels > 2][serpentine && (y & 1)];
+		span(gray, &err[i0 * cols], &err[i1 * cols], &err[i2 * cols],
+		    outrow, 0, width);
+		stats_lap("dither", &clock);
+
+		write_row(outrow, width, outbuf);
+		stats_lap("write", &clock);
+	}
+
+	pbm_freerow(outrow);
+	free(err);
+	free(outbuf);
+	free(gray);
+	source_close(&src);
+}
+
+/*
+ * Wavefront dithering: thread t dithers rows t, t + nthreads, ... and
+ * trails the row above by the kernel's lag. Every row publishes how many of
+ * its pixels are done in progress[y], the main thread publishes the
+ * number of rows read in nread. Error rows are shared in a ring of
+ * nthreads + 2 rows; the row that last used the slot for row y + 2
+ * is y - nthreads, which the same thread already finished.
+ */
+struct wavefront {
+	struct pam *inpam;
+	span_fn span;
+	int lag;
+	int width, height;
+	int nthreads;
+	ushort *gray;
+	bit *bits;
+	int *err;
+	int nerr, cols;
+	int *progress;
+	int nread;
+};
+
+struct worker {
+	struct wavefront *wf;
+	int id;
+};
+
+static int
+load(int *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void
+store(int *p, int v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void
+wait_for(int *p, int v)
+{
+	while (load(p) < v)
+		sched_yield();
+}
 
-			/* +1 offset for left padding */
-			idx = x + 1;
+static void *
+wavefront_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct wavefront *wf = w->wf;
+	int width = wf->width;
+	int y;
 
-			/* Compute grayscale intensity */
-			Y = row[x][R] * 21 / 100 +
-			    row[x][G] * 72 / 100 +
-			    row[x][B] *  7 / 100;
+	for (y = w->id; y < wf->height; y += wf->nthreads) {
+		int *e0 = &wf->err[(y + 0) % wf->nerr * wf->cols];
+		int *e1 = &wf->err[(y + 1) % wf->nerr * wf->cols];
+		int *e2 = &wf->err[(y + 2) % wf->nerr * wf->cols];
+		const ushort *gray = &wf->gray[(size_t)y * width];
+		bit *out = &wf->bits[(size_t)y * width];
+		int x0;
 
-			Y += err[i0 * cols + idx];
+		wait_for(&wf->nread, y + 1);
 
-			cv = (Y > 127) ? 255 : 0;
-			diff = Y - cv;
+		/* Clear the error buffer for row y+2 */
+		memset(e2, 0, wf->cols * sizeof(*e2));
 
-			/* Distribute error */
-			err[i0 * cols + idx + 1] += diff / 8;
-			err[i0 * cols + idx + 2] += diff / 8;
+		for (x0 = 0; x0 < width; x0 += CHUNK) {
+			int x1 = x0 + CHUNK < width ? x0 + CHUNK : width;
 
-			err[i1 * cols + idx - 1] += diff / 8;
-			err[i1 * cols + idx + 0] += diff / 8;
-			err[i1 * cols + idx + 1] += diff / 8;
+			if (y > 0) {
+				int need = x1 - 1 + wf->lag;
 
-			err[i2 * cols + idx + 0] += diff / 8;
+				wait_for(&wf->progress[y - 1],
+				    need < width ? need : width);
+			}
 
-			outrow[x] = (cv == 0) ? PBM_BLACK : PBM_WHITE;
+			wf->span(gray, e0, e1, e2, out, x0, x1);
+			store(&wf->progress[y], x1);
 		}
+	}
+
+	return NULL;
+}
+
+static void
+dither_threaded(struct pam *inpam, const struct kernel *k, int nthreads)
+{
+	struct wavefront wf;
+	struct worker *workers;
+	pthread_t *threads;
+	struct source src;
+	uchar *outbuf;
+	unsigned long clock;
+	int i, y;
 
-		pbm_writepbmrow(stdout, outrow, width, 0);
+	wf.inpam = inpam;
+	wf.span = k->span[levels > 2][0];
+	wf.lag = diffuse_lag(k);
+	wf.width = inpam->width;
+	wf.height = inpam->height;
+	wf.nthreads = nthreads;
+	wf.gray = xmalloc((size_t)wf.width * wf.height * sizeof(*wf.gray));
+	wf.bits = xmalloc((size_t)wf.width * wf.height * sizeof(*wf.bits));
+	wf.cols = wf.width + 2 * DIFFUSE_PAD;
+	wf.nerr = nthreads + 2;
+	wf.err = calloc((size_t)wf.nerr * wf.cols, sizeof(*wf.err));
+	wf.progress = calloc(wf.height, sizeof(*wf.progress));
+	wf.nread = 0;
+	if (!wf.err || !wf.progress) {
+		perror("calloc");
+		exit(1);
 	}
 
-	pbm_freerow(outrow);
-	free(err);
-	pnm_freepamrow(row);
+	workers = xmalloc(nthreads * sizeof(*workers));
+	threads = xmalloc(nthreads * sizeof(*threads));
+	for (i = 0; i < nthreads; ++i) {
+		workers[i].wf = &wf;
+		workers[i].id = i;
+		if (pthread_create(&threads[i], NULL, wavefront_worker,
+		    &workers[i]) != 0) {
+			fprintf(stderr, "pthread_create failed.\n");
+			exit(1);
+		}
+	}
+
+	/* Read while the workers dither... */
+	source_open(&src, inpam);
+	clock = stats_clock();
+	for (y = 0; y < wf.height; ++y) {
+		source_gray_row(&src, &wf.gray[(size_t)y * wf.width], &clock);
+		store(&wf.nread, y + 1);
+	}
+	source_close(&src);
+
+	/*
+	 * ...and write rows as soon as they are done. Time spent waiting
+	 * here counts as dithering that did not overlap with reading.
+	 */
+	write_init(wf.width, wf.height);
+	outbuf = alloc_outbuf(wf.width);
+	for (y = 0; y < wf.height; ++y) {
+		wait_for(&wf.progress[y], wf.width);
+		stats_lap("dither", &clock);
+		write_row(&wf.bits[(size_t)y * wf.width], wf.width, outbuf);
+		stats_lap("write", &clock);
+	}
+	free(outbuf);
+
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	free(workers);
+	free(wf.progress);
+	free(wf.err);
+	free(wf.bits);
+	free(wf.gray);
+}
+
+static void
+usage(void)
+{
+	int i;
+
+	fprintf(stderr, "usage: atkinson [-nsv] [-k kernel] [-l levels] "
+	    "[-t threads] < in.pam > out.pbm\n");
+	fprintf(stderr, "kernels:");
+	for (i = 0; i < diffuse_nkernels; ++i)
+		fprintf(stderr, " %s", diffuse_kernels[i].name);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pam inpam;
+	const struct kernel *k = &diffuse_kernels[0];
+	int serpentine = 0, verbose = 0;
+	int nthreads = 1;
+	int ch;
+
+	pm_init(argv[0], 0);
+
+	while ((ch = getopt(argc, argv, "k:l:nst:v")) != -1) {
+		switch (ch) {
+		case 'k':
+			k = diffuse_find(optarg);
+			if (k == NULL)
+				usage();
+			break;
+		case 'l':
+			levels = atoi(optarg);
+			if (levels < 2 || levels > 256)
+				usage();
+			break;
+		case 'n':
+			use_netpbm = 1;
+			break;
+		case 's':
+			serpentine = 1;
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			if (nthreads == 0)
+				nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+			if (nthreads < 1)
+				usage();
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	/*
+	 * A right to left row needs the whole row above it, so there is
+	 * nothing to run in parallel.
+	 */
+	if (serpentine && nthreads > 1) {
+		fprintf(stderr, "serpentine scanning needs a single thread.\n");
+		exit(1);
+	}
+
+	stats_init("atkinson", verbose);
+
+	if (levels > 2)
+		diffuse_levels(levels);
+
+	pnm_readpaminit(stdin, &inpam, PAM_STRUCT_SIZE(tuple_type));
+
+	if (nthreads > inpam.height)
+		nthreads = inpam.height > 0 ? inpam.height : 1;
+
+	if (nthreads == 1)
+		dither_serial(&inpam, k, serpentine);
+	else
+		dither_threaded(&inpam, k, nthreads);
+
+	stats_count("pixels", (unsigned long)inpam.width * inpam.height);
+
 	return 0;
 }
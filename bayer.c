@@ -1,146 +1,293 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <limits.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
 
 #include <netpbm/pam.h>
 
-typedef unsigned int uint;
+#include "ordered.h"
+#include "rawpnm.h"
+#include "stats.h"
 
-enum RGB { R, G, B };
+typedef unsigned char uchar;
 
-#if 0 /* CGA Palette 0 low intensity */
-#define PALETTE_SIZE 4
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x00, 0xaa, 0x00 },
-	{ 0xaa, 0x00, 0x00 },
-	{ 0xaa, 0x55, 0x00 },
-};
-#endif
-
-#if 0 /* CGA Palette 0 high intensity */
-#define PALETTE_SIZE 4
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x55, 0xff, 0x55 },
-	{ 0xff, 0x55, 0x55 },
-	{ 0xff, 0xff, 0x55 },
-};
-#endif
-
-#if 0 /* CGA Palette 1 low intensity */
-#define PALETTE_SIZE 4
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x00, 0xaa, 0xaa },
-	{ 0xaa, 0x00, 0xaa },
-	{ 0xaa, 0xaa, 0xaa },
-};
-#endif
-
-#if 0 /* CGA Palette 1 high intensity */
-#define PALETTE_SIZE 4
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x55, 0xff, 0xff },
-	{ 0xff, 0x55, 0xff },
-	{ 0xff, 0xff, 0xff },
-};
-#endif
-
-#if 1 /* CGA Mode5 low intensity */
-#define PALETTE_SIZE 4
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x00, 0xaa, 0xaa },
-	{ 0xaa, 0x00, 0x00 },
-	{ 0xaa, 0xaa, 0xaa },
-};
-#endif
-
-#if 0 /* CGA Mode5 high intensity */
-#define PALETTE_SIZE 4
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x55, 0xff, 0xff },
-	{ 0xff, 0x55, 0x55 },
-	{ 0xff, 0xff, 0xff },
-};
-#endif
-
-#if 0 /* CGA Full palette */
-#define PALETTE_SIZE 16
-int palette[PALETTE_SIZE][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x00, 0x00, 0xaa },
-	{ 0x00, 0xaa, 0x00 },
-	{ 0x00, 0xaa, 0xaa },
-	{ 0xaa, 0x00, 0x00 },
-	{ 0xaa, 0x00, 0xaa },
-	{ 0xaa, 0x55, 0x00 },
-	{ 0xaa, 0xaa, 0xaa },
-	{ 0x55, 0x55, 0x55 },
-	{ 0x55, 0x55, 0xff },
-	{ 0x55, 0xff, 0x55 },
-	{ 0x55, 0xff, 0xff },
-	{ 0xff, 0x55, 0x55 },
-	{ 0xff, 0x55, 0xff },
-	{ 0xff, 0xff, 0x55 },
-	{ 0xff, 0xff, 0xff },
+static void
+dither_netpbm(struct pam *inpam, struct pam *outpam)
+{
+	tuple *row = NULL;
+	int y;
+
+	row = pnm_allocpamrow(inpam);
+	for (y = 0; y < inpam->height; ++y) {
+		pnm_readpamrow(inpam, row);
+		ordered_tuple_row(row, inpam->width, y);
+		pnm_writepamrow(outpam, row);
+	}
+	pnm_freepamrow(row);
+}
+
+/*
+ * Dither raw 8-bit rows without going through tuples.
+ */
+static void
+dither_raw(struct rawpnm *raw, FILE *out)
+{
+	uchar *outrow;
+	int y;
+
+	outrow = malloc(raw->rowbytes + 1);
+	if (outrow == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (y = 0; y < raw->height; ++y) {
+		ordered_row(outrow, rawpnm_readrow(raw), y);
+		rawpnm_writerow(out, outrow, raw->rowbytes);
+	}
+
+	free(outrow);
+}
+
+/*
+ * Band pipeline: the main thread reads bands of BAND rows into a ring
+ * of nslots buffers, thread t dithers bands t, t + nthreads, ... in
+ * place and a writer thread writes them out in order. A slot is reused
+ * only after the band that was in it has been written, so at most
+ * nslots bands are in memory whatever the image size.
+ */
+#define BAND 32
+
+struct pipeline {
+	struct rawpnm *raw;
+	FILE *out;
+	int nthreads;
+	int nbands, nslots;
+	uchar *slots;
+	int *done;
+	int nread, nwritten;
 };
-#endif
-
-int bayer[8][8] = {
-	{  0, 32,  8, 40,  2, 34, 10, 42 },
-	{ 48, 16, 56, 24, 50, 18, 58, 26 },
-	{ 12, 44,  4, 36, 14, 46,  6, 38 },
-	{ 60, 28, 52, 20, 62, 30, 54, 22 },
-	{  3, 35, 11, 43,  1, 33,  9, 41 },
-	{ 51, 19, 59, 27, 49, 17, 57, 25 },
-	{ 15, 47,  7, 39, 13, 45,  5, 37 },
-	{ 63, 31, 55, 23, 61, 29, 53, 21 },
+
+struct worker {
+	struct pipeline *pl;
+	int id;
 };
 
 static int
-pick(int *c)
+load(int *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void
+store(int *p, int v)
 {
-	int maxdist = INT_MAX;
-	int match = 0;
-	int i;
-
-	for (i = 0; i < PALETTE_SIZE; ++i) {
-		int w[3] = { 3, 4, 2 };
-		int diff[3];
-		int dist;
-
-		diff[R] = abs(c[R] - palette[i][R]);
-		diff[G] = abs(c[G] - palette[i][G]);
-		diff[B] = abs(c[B] - palette[i][B]);
-
-		if ((c[R] + palette[i][R]) / 2 < 128) {
-			w[R] = 2;
-			w[B] = 3;
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void
+wait_for(int *p, int v)
+{
+	while (load(p) < v)
+		sched_yield();
+}
+
+static uchar *
+band_slot(struct pipeline *pl, int band)
+{
+	return pl->slots + (size_t)(band % pl->nslots) * BAND *
+	    pl->raw->rowbytes;
+}
+
+static int
+band_rows(struct pipeline *pl, int band)
+{
+	int rows = pl->raw->height - band * BAND;
+
+	return rows < BAND ? rows : BAND;
+}
+
+static void *
+band_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct pipeline *pl = w->pl;
+	size_t rowbytes = pl->raw->rowbytes;
+	int band, i;
+
+	for (band = w->id; band < pl->nbands; band += pl->nthreads) {
+		uchar *row = band_slot(pl, band);
+
+		wait_for(&pl->nread, band + 1);
+		for (i = 0; i < band_rows(pl, band); ++i) {
+			ordered_row(row, row, band * BAND + i);
+			row += rowbytes;
 		}
+		store(&pl->done[band], 1);
+	}
+
+	return NULL;
+}
+
+static void *
+band_writer(void *arg)
+{
+	struct pipeline *pl = arg;
+	int band;
+
+	for (band = 0; band < pl->nbands; ++band) {
+		wait_for(&pl->done[band], 1);
+		rawpnm_writerow(pl->out, band_slot(pl, band),
+		    band_rows(pl, band) * pl->raw->rowbytes);
+		store(&pl->nwritten, band + 1);
+	}
+
+	return NULL;
+}
+
+static void
+dither_threaded(struct rawpnm *raw, FILE *out, int nthreads)
+{
+	struct pipeline pl;
+	struct worker *workers;
+	pthread_t *threads, writer;
+	int band, i;
+
+	pl.raw = raw;
+	pl.out = out;
+	pl.nthreads = nthreads;
+	pl.nbands = (raw->height + BAND - 1) / BAND;
+	pl.nslots = 2 * nthreads;
+	pl.slots = malloc((size_t)pl.nslots * BAND * raw->rowbytes);
+	pl.done = calloc(pl.nbands, sizeof(*pl.done));
+	pl.nread = pl.nwritten = 0;
+	workers = malloc(nthreads * sizeof(*workers));
+	threads = malloc(nthreads * sizeof(*threads));
+	if (!pl.slots || !pl.done || !workers || !threads) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (i = 0; i < nthreads; ++i) {
+		workers[i].pl = &pl;
+		workers[i].id = i;
+		if (pthread_create(&threads[i], NULL, band_worker,
+		    &workers[i]) != 0) {
+			fprintf(stderr, "pthread_create failed.\n");
+			exit(1);
+		}
+	}
+	if (pthread_create(&writer, NULL, band_writer, &pl) != 0) {
+		fprintf(stderr, "pthread_create failed.\n");
+		exit(1);
+	}
+
+	for (band = 0; band < pl.nbands; ++band) {
+		uchar *row = band_slot(&pl, band);
 
-		dist = w[R] * diff[R] + w[G] * diff[G] + w[B] * diff[B];
-		if (dist < maxdist) {
-			maxdist = dist;
-			match = i;
+		wait_for(&pl.nwritten, band - pl.nslots + 1);
+		for (i = 0; i < band_rows(&pl, band); ++i) {
+			memcpy(row, rawpnm_readrow(raw), raw->rowbytes);
+			row += raw->rowbytes;
 		}
+		store(&pl.nread, band + 1);
 	}
 
-	return match;
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	pthread_join(writer, NULL);
+
+	free(threads);
+	free(workers);
+	free(pl.done);
+	free(pl.slots);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: bayer [-en] [-d rgb|lab|oklab] [-m size|texture.pgm] "
+	    "[-p palette]\n"
+	    "             [-s simd] [-t threads] < in.ppm > out.ppm\n"
+	    "       bayer [-p palette] -V\n\n");
+	ordered_list_palettes(stderr);
+	fprintf(stderr, "\n");
+	ordered_list_simd(stderr);
+	fprintf(stderr, "\nthreads only apply to 8-bit input, "
+	    "0 is one per cpu.\n");
+	exit(1);
 }
 
 int
 main(int argc, char **argv)
 {
 	struct pam inpam, outpam;
-	tuple *row = NULL;
-	int x, y;
+	struct rawpnm raw;
+	const char *palette_name = ORDERED_DEFAULT_PALETTE;
+	const char *simd_name = NULL;
+	const char *matrix = "8";
+	const char *metric_name = "rgb";
+	int use_netpbm = 0, exhaustive = 0, validate = 0;
+	int nthreads = 1;
+	unsigned long clock;
+	int ch;
 
-	(void) argc;
 	pm_init(argv[0], 0);
+
+	while ((ch = getopt(argc, argv, "d:em:p:ns:t:V")) != -1) {
+		switch (ch) {
+		case 'd':
+			metric_name = optarg;
+			break;
+		case 'e':
+			exhaustive = 1;
+			break;
+		case 'm':
+			matrix = optarg;
+			break;
+		case 'p':
+			palette_name = optarg;
+			break;
+		case 'n':
+			use_netpbm = 1;
+			break;
+		case 's':
+			simd_name = optarg;
+			break;
+		case 't':
+			nthreads = atoi(optarg);
+			if (nthreads == 0)
+				nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+			if (nthreads < 1)
+				usage();
+			break;
+		case 'V':
+			validate = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	ordered_palette(palette_name);
+	if (!ordered_metric(metric_name)) {
+		fprintf(stderr, "%s: unknown distance metric.\n", metric_name);
+		exit(1);
+	}
+
+	if (validate)
+		return ordered_validate() ? 0 : 1;
+
+	stats_init("bayer", 0);
+	clock = stats_clock();
+	ordered_texture(matrix);
+	ordered_init(exhaustive);
+	stats_lap("init", &clock);
+
 	pnm_readpaminit(stdin, &inpam, PAM_STRUCT_SIZE(tuple_type));
 	if (inpam.depth < 3) {
 		fprintf(stderr, "input should have at least a depth of 3.\n");
@@ -150,32 +297,18 @@ main(int argc, char **argv)
 	outpam.file = stdout;
 	pnm_writepaminit(&outpam);
 
-	row = pnm_allocpamrow(&inpam);
-	for (y = 0; y < inpam.height; ++y) {
-		pnm_readpamrow(&inpam, row);
-		for (x = 0; x < inpam.width; ++x) {
-			int c[3];
-			int i;
-			uint bv, cv;
-
-			bv = bayer[y & 7][x & 7];
-			cv = row[x][R] + row[x][R] * bv / 64;
-			c[R] = cv > 255 ? 255 : cv;
-
-			cv = row[x][G] + row[x][G] * bv / 64;
-			c[G] = cv > 255 ? 255 : cv;
-
-			cv = row[x][B] + row[x][B] * bv / 64;
-			c[B] = cv > 255 ? 255 : cv;
-
-			i = pick(c);
-			row[x][R] = palette[i][R];
-			row[x][G] = palette[i][G];
-			row[x][B] = palette[i][B];
-		}
-		pnm_writepamrow(&outpam, row);
-	}
-	pnm_freepamrow(row);
+	if (!use_netpbm && rawpnm_open(&raw, &inpam)) {
+		ordered_simd(simd_name);
+		ordered_rows(raw.width, raw.depth);
+		if (nthreads > 1)
+			dither_threaded(&raw, stdout, nthreads);
+		else
+			dither_raw(&raw, stdout);
+		rawpnm_close(&raw);
+	} else
+		dither_netpbm(&inpam, &outpam);
+	stats_lap("dither", &clock);
+	stats_count("pixels", (unsigned long)inpam.width * inpam.height);
 
 	return 0;
 }
@@ -0,0 +1,51 @@
+#! /bin/sh
+#
+# Time atkinson with 1 up to N threads on a large generated image and
+# check that every thread count produces the same output.
+#
+# usage: atkinson-scale.sh [max threads]
+#
+
+maxthreads="${1:-$(nproc)}"
+size="${SIZE:-10240x10240}"
+atkinson="${ATKINSON:-./atkinson}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$atkinson" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" noise "$size" > "$tmpdir/in.ppm"
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "threads\twall_s\tmpixel_s\tspeedup\trss_kb\n"
+
+t=1
+while [ "$t" -le "$maxthreads" ]; do
+    "$runstat" -o "$tmpdir/stat" "$atkinson" -t "$t" \
+        < "$tmpdir/in.ppm" > "$tmpdir/out.pbm"
+    read -r wall rss < "$tmpdir/stat"
+
+    sum=$(cksum < "$tmpdir/out.pbm")
+    if [ "$t" -eq 1 ]; then
+        ref="$sum"
+        base="$wall"
+    fi
+    [ "$sum" = "$ref" ] || die "output with $t threads differs."
+
+    awk -v t="$t" -v w="$wall" -v b="$base" -v mp="$mpixels" -v r="$rss" \
+        'BEGIN { printf "%d\t%.3f\t%.1f\t%.2f\t%d\n", t, w, mp / w, b / w, r }'
+    t=$((t + 1))
+done
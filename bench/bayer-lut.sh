@@ -0,0 +1,64 @@
+#! /bin/sh
+#
+# Mpixel/s of bayer with the palette lookup table against searching
+# the palette for every pixel (-e), for each palette given. The
+# palette "web" is a generated 256 color GIMP palette.
+#
+# usage: bayer-lut.sh [palette...]
+#
+
+bayer="${BAYER:-./bayer}"
+size="${SIZE:-8192x8192}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+[ "$#" -gt 0 ] || set -- cga5-low cga web
+for prg in "$bayer" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+# 6x7x6 color cube plus 4 grays.
+awk 'BEGIN {
+    print "GIMP Palette"
+    print "Name: web"
+    for (r = 0; r < 6; r++)
+        for (g = 0; g < 7; g++)
+            for (b = 0; b < 6; b++)
+                printf "%d %d %d\n", r * 51, int(g * 255 / 6), b * 51
+    for (i = 1; i <= 4; i++)
+        printf "%d %d %d\n", i * 51 - 26, i * 51 - 26, i * 51 - 26
+}' > "$tmpdir/web.gpl"
+
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "palette\timage\tsearch\twall_s\tmpixel_s\n"
+
+for image in gradient noise; do
+    "$gencorpus" "$image" "$size" > "$tmpdir/in.ppm"
+    for palette in "$@"; do
+        p="$palette"
+        [ "$p" = web ] && p="$tmpdir/web.gpl"
+        for search in e lut; do
+            flag=""
+            [ "$search" = e ] && flag="-e"
+            "$runstat" -o "$tmpdir/stat" "$bayer" -p "$p" $flag \
+                < "$tmpdir/in.ppm" > "$tmpdir/$search.ppm"
+            read -r wall rss < "$tmpdir/stat"
+            awk -v b="$palette" -v i="$image" -v s="$search" \
+                -v w="$wall" -v mp="$mpixels" \
+                'BEGIN { printf "%s\t%s\t%s\t%.3f\t%.1f\n", b, i, s, w, mp / w }'
+        done
+        cmp -s "$tmpdir/e.ppm" "$tmpdir/lut.ppm" ||
+            die "$palette: lookup table output differs."
+    done
+done
@@ -0,0 +1,41 @@
+#! /bin/sh
+#
+# Mpixel/s of bayer for each bayer matrix size and a 64x64 blue noise
+# texture, so a quality/speed point can be picked per machine.
+#
+
+size="${SIZE:-8192x8192}"
+bayer="${BAYER:-./bayer}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$bayer" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" gradient "$size" > "$tmpdir/in.ppm"
+"$gencorpus" bluenoise 64x64 > "$tmpdir/bluenoise.pgm"
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "matrix\twall_s\tmpixel_s\trss_kb\n"
+
+for matrix in 2 4 8 16 32 64 bluenoise; do
+    m="$matrix"
+    [ "$m" = bluenoise ] && m="$tmpdir/bluenoise.pgm"
+    "$runstat" -o "$tmpdir/stat" "$bayer" -m "$m" \
+        < "$tmpdir/in.ppm" > "$tmpdir/out.ppm"
+    read -r wall rss < "$tmpdir/stat"
+    awk -v m="$matrix" -v w="$wall" -v mp="$mpixels" -v r="$rss" \
+        'BEGIN { printf "%s\t%.3f\t%.1f\t%d\n", m, w, mp / w, r }'
+done
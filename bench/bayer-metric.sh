@@ -0,0 +1,49 @@
+#! /bin/sh
+#
+# Mpixel/s of bayer for each distance metric (-d), searching the
+# palette for every pixel (-e) against the lookup table or memo cache,
+# on the 4 and 16 color palettes. Both ways must give the same output.
+#
+
+size="${SIZE:-4096x4096}"
+bayer="${BAYER:-./bayer}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$bayer" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" gradient "$size" > "$tmpdir/in.ppm"
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "metric\tpalette\tsearch\twall_s\tmpixel_s\n"
+
+for metric in rgb lab oklab; do
+    for palette in cga5-low cga; do
+        for search in e fast; do
+            flag=""
+            [ "$search" = e ] && flag="-e"
+            "$runstat" -o "$tmpdir/stat" "$bayer" -d "$metric" \
+                -p "$palette" $flag < "$tmpdir/in.ppm" > "$tmpdir/$search.ppm"
+            read -r wall rss < "$tmpdir/stat"
+            awk -v d="$metric" -v p="$palette" -v s="$search" -v w="$wall" \
+                -v mp="$mpixels" 'BEGIN {
+                    printf "%s\t%s\t%s\t%.3f\t%.1f\n", d, p, s, w, mp / w
+                }'
+        done
+        cmp -s "$tmpdir/e.ppm" "$tmpdir/fast.ppm" ||
+            die "$metric $palette: output differs from -e."
+    done
+done
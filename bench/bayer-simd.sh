@@ -0,0 +1,52 @@
+#! /bin/sh
+#
+# Mpixel/s of the bayer row kernels (-s) against the netpbm path (-n).
+# Kernels the cpu doesn't support are skipped. All outputs must be the
+# same.
+#
+
+size="${SIZE:-8192x8192}"
+bayer="${BAYER:-./bayer}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$bayer" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "image\tkernel\twall_s\tmpixel_s\n"
+
+for image in gradient noise; do
+    "$gencorpus" "$image" "$size" > "$tmpdir/in.ppm"
+    for kernel in netpbm scalar sse2 avx2; do
+        if [ "$kernel" = netpbm ]; then
+            flag="-n"
+        else
+            flag="-s $kernel"
+        fi
+        "$runstat" -o "$tmpdir/stat" "$bayer" $flag \
+            < "$tmpdir/in.ppm" > "$tmpdir/out.ppm" 2> "$tmpdir/err" ||
+            continue
+        read -r wall rss < "$tmpdir/stat"
+        awk -v i="$image" -v k="$kernel" -v w="$wall" -v mp="$mpixels" \
+            'BEGIN { printf "%s\t%s\t%.3f\t%.1f\n", i, k, w, mp / w }'
+        if [ "$kernel" = netpbm ]; then
+            mv "$tmpdir/out.ppm" "$tmpdir/ref.ppm"
+        else
+            cmp -s "$tmpdir/ref.ppm" "$tmpdir/out.ppm" ||
+                die "$kernel: output differs from netpbm."
+        fi
+    done
+done
@@ -0,0 +1,78 @@
+#! /bin/sh
+#
+# Time the awk pass bitrate_histogram used to do against bitrate on a
+# generated packet list of a long video. Both must give the same
+# histogram.
+#
+
+hours="${HOURS:-10}"
+bitrate="${BITRATE:-./bitrate}"
+runstat="${RUNSTAT:-./bench/runstat}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$bitrate" "$runstat"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+# 25 fps with a keyframe every 5 seconds and a slowly changing rate.
+awk -v n="$((hours * 3600 * 25))" 'BEGIN {
+    srand(1)
+    for (i = 0; i < n; i++) {
+        t = i / 25
+        rate = 1500 + 700 * sin(t / 60)
+        size = int(rate * 5 * (i % 125 == 0 ? 4 : 0.97) * (0.7 + rand() * 0.6))
+        printf "%.6f,%.6f,%d\n", t, t, size
+    }
+}' > "$tmpdir/packets.csv"
+mb=$(du -k "$tmpdir/packets.csv" | awk '{ print $1 / 1024 }')
+
+cat > "$tmpdir/histogram.awk" <<'AWK'
+{
+    t = ($1 != "N/A") ? $1 : $2;
+    if (!is_t0_set) {
+        t0 = t;
+        is_t0_set = 1;
+    }
+    second = int(t - t0);
+    bytes[second] += $3;
+}
+END {
+    for (second in bytes) {
+        kilobits = bytes[second] * 8 / 1000;
+        bin = int(kilobits / binwidth) * binwidth + binwidth / 2;
+        count[bin]++;
+    }
+    for (bin in count)
+        printf "%d %d\n", bin, count[bin];
+}
+AWK
+
+printf "%s hours, %s MB of packets\n" "$hours" "$mb"
+printf "tool\twall_s\tmb_s\trss_kb\n"
+
+report() {
+    read -r wall rss < "$tmpdir/stat"
+    awk -v t="$1" -v w="$wall" -v mb="$mb" -v r="$rss" \
+        'BEGIN { printf "%s\t%.3f\t%.1f\t%d\n", t, w, mb / w, r }'
+}
+
+"$runstat" -o "$tmpdir/stat" sh -c \
+    'awk -F, -v binwidth=50 -f "$1/histogram.awk" "$1/packets.csv" |
+        sort -n > "$1/awk.hist"' sh "$tmpdir"
+report awk
+
+"$runstat" -o "$tmpdir/stat" "$bitrate" -o "$tmpdir/bitrate.hist" \
+    "$tmpdir/packets.csv" > /dev/null
+report bitrate
+
+cmp -s "$tmpdir/awk.hist" "$tmpdir/bitrate.hist" ||
+    die "histograms differ."
@@ -0,0 +1,93 @@
+#! /bin/sh
+#
+# Benchmark the rle and packbits compressors over a generated corpus.
+# Appends one csv line per tool and corpus to the results file so runs
+# on different commits can be compared.
+#
+# usage: compress.sh [results.csv]
+#
+
+results="${1:-bench-compress.csv}"
+size="${CORPUS_SIZE:-16777216}"
+repeat="${REPEAT:-3}"
+rle="${RLE:-./rle}"
+packbits="${PACKBITS:-./packbits/packbits}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$rle" "$packbits" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+failed=0
+
+# Run a command $repeat times, keep the fastest wall time and the
+# largest peak rss.
+measure() {
+    best=""
+    rss=0
+    i=0
+    while [ "$i" -lt "$repeat" ]; do
+        "$runstat" -o "$tmpdir/stat" "$@" ||
+            die "$*: failed."
+        read -r wall kb < "$tmpdir/stat"
+        best=$(awk -v a="$best" -v b="$wall" \
+            'BEGIN { print (a == "" || b < a) ? b : a }')
+        [ "$kb" -gt "$rss" ] && rss=$kb
+        i=$((i + 1))
+    done
+    printf "%s %s\n" "$best" "$rss"
+}
+
+# tool name, program, compress flag, decompress flag, corpus
+run() {
+    tool=$1 prg=$2 cflag=$3 dflag=$4 corpus=$5
+    in="$tmpdir/$corpus"
+
+    set -- $(measure "$prg" "$cflag" "$in" "$tmpdir/packed")
+    enc_wall=$1 enc_rss=$2
+    set -- $(measure "$prg" "$dflag" "$tmpdir/packed" "$tmpdir/unpacked")
+    dec_wall=$1 dec_rss=$2
+
+    bytes=$(wc -c < "$in")
+    packed=$(wc -c < "$tmpdir/packed")
+    roundtrip=ok
+    if ! cmp -s "$in" "$tmpdir/unpacked"; then
+        roundtrip=FAIL
+        failed=1
+    fi
+
+    awk -v commit="$commit" -v tool="$tool" -v corpus="$corpus" \
+        -v bytes="$bytes" -v packed="$packed" \
+        -v ew="$enc_wall" -v dw="$dec_wall" \
+        -v er="$enc_rss" -v dr="$dec_rss" -v rt="$roundtrip" '
+    function mbs(wall) { return wall > 0 ? bytes / 1048576 / wall : 0 }
+    BEGIN {
+        printf "%s,%s,%s,%d,%d,%.4f,%.1f,%.1f,%d,%d,%s\n",
+            commit, tool, corpus, bytes, packed, packed / bytes,
+            mbs(ew), mbs(dw), er, dr, rt
+    }' | tee -a "$results"
+}
+
+[ -s "$results" ] || printf "%s\n" \
+    "commit,tool,corpus,bytes,packed,ratio,enc_mbs,dec_mbs,enc_rss_kb,dec_rss_kb,roundtrip" \
+    > "$results"
+
+for corpus in zeros random text pbm mixed; do
+    "$gencorpus" "$corpus" "$size" > "$tmpdir/$corpus"
+    run rle "$rle" c d "$corpus"
+    run packbits "$packbits" -c -d "$corpus"
+done
+
+[ "$failed" -eq 0 ] || die "round trip failed, see $results."
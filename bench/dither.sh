@@ -0,0 +1,113 @@
+#! /bin/sh
+#
+# Benchmark the dithering tools over generated images of a few kinds
+# and sizes. Appends one csv line per tool, flags and image with
+# Mpixel/s, peak rss and a checksum of the output to the results file.
+# A checksum that differs from the last one recorded on another commit
+# is marked CHANGED, so a speedup can be shown not to change output.
+#
+# usage: dither.sh [results.csv]
+#
+
+results="${1:-bench-dither.csv}"
+sizes="${SIZES:-640x480 1920x1080 4096x4096}"
+kinds="${KINDS:-gradient noise photo}"
+repeat="${REPEAT:-3}"
+atkinson="${ATKINSON:-./atkinson}"
+bayer="${BAYER:-./bayer}"
+imgpipe="${IMGPIPE:-./imgpipe}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$atkinson" "$bayer" "$imgpipe" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+commit=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+changed=0
+
+# Run a command $repeat times on the input image, keep the fastest wall
+# time and the largest peak rss.
+measure() {
+    best=""
+    rss=0
+    i=0
+    while [ "$i" -lt "$repeat" ]; do
+        "$runstat" -o "$tmpdir/stat" "$@" \
+            < "$tmpdir/in.ppm" > "$tmpdir/out" ||
+            die "$*: failed."
+        read -r wall kb < "$tmpdir/stat"
+        best=$(awk -v a="$best" -v b="$wall" \
+            'BEGIN { print (a == "" || b < a) ? b : a }')
+        [ "$kb" -gt "$rss" ] && rss=$kb
+        i=$((i + 1))
+    done
+    printf "%s %s\n" "$best" "$rss"
+}
+
+# tool name, program, flags...
+run() {
+    tool=$1 prg=$2
+    shift 2
+    flags="$*"
+
+    set -- $(measure "$prg" "$@")
+    wall=$1 rss=$2
+    sum=$(cksum < "$tmpdir/out" | awk '{ print $1 }')
+
+    # Compare with the last checksum for the same run on another commit.
+    prev=$(awk -F, -v c="$commit" -v t="$tool" -v f="$flags" \
+        -v k="$kind" -v s="$size" '
+        $1 != c && $2 == t && $3 == f && $4 == k && $5 == s { sum = $10 }
+        END { print sum }' "$results")
+    output=same
+    [ -n "$prev" ] || output=new
+    if [ -n "$prev" ] && [ "$prev" != "$sum" ]; then
+        output=CHANGED
+        changed=1
+    fi
+
+    awk -v commit="$commit" -v tool="$tool" -v flags="$flags" \
+        -v kind="$kind" -v size="$size" -v mp="$mpixels" \
+        -v wall="$wall" -v rss="$rss" -v sum="$sum" -v out="$output" '
+    BEGIN {
+        printf "%s,%s,%s,%s,%s,%.2f,%.3f,%.1f,%d,%s,%s\n",
+            commit, tool, flags, kind, size, mp, wall,
+            (wall > 0 ? mp / wall : 0), rss, sum, out
+    }' | tee -a "$results"
+}
+
+[ -s "$results" ] || printf "%s\n" \
+    "commit,tool,flags,image,size,mpixels,wall_s,mpixel_s,rss_kb,cksum,output" \
+    > "$results"
+
+for size in $sizes; do
+    mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+    for kind in $kinds; do
+        "$gencorpus" "$kind" "$size" > "$tmpdir/in.ppm"
+
+        run atkinson "$atkinson"
+        run atkinson "$atkinson" -k floyd
+        run atkinson "$atkinson" -k sierra -l 4
+        run atkinson "$atkinson" -t 0
+        run bayer "$bayer"
+        run bayer "$bayer" -p cga
+        run bayer "$bayer" -p cga -d oklab
+        run bayer "$bayer" -m 16 -t 0
+        run imgpipe "$imgpipe" gray diffuse=floyd
+        run imgpipe "$imgpipe" bayer=cga gray diffuse=floyd
+        run imgpipe "$imgpipe" -t bayer=cga gray diffuse=floyd
+    done
+done
+
+[ "$changed" -eq 0 ] || die "output changed, see $results."
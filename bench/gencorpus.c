@@ -0,0 +1,538 @@
+/*
+ * Generate deterministic benchmark inputs on stdout.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char uchar;
+typedef unsigned long ulong;
+
+static ulong state = 2463534242UL;
+
+/* xorshift32, the same sequence on every run and platform */
+static ulong
+rnd(void)
+{
+	state ^= (state << 13) & 0xffffffffUL;
+	state ^= state >> 17;
+	state ^= (state << 5) & 0xffffffffUL;
+
+	return state;
+}
+
+static void
+gen_zeros(long size)
+{
+	while (size-- > 0)
+		putchar(0);
+}
+
+static void
+gen_random(long size)
+{
+	while (size-- > 0)
+		putchar(rnd() & 0xff);
+}
+
+static void
+gen_text(long size)
+{
+	static const char *words[] = {
+		"the", "of", "and", "a", "to", "in", "is", "you", "that",
+		"it", "he", "was", "for", "on", "are", "as", "with", "his",
+		"they", "at", "be", "this", "have", "from", "or", "one",
+		"had", "by", "word", "but", "not", "what", "all", "were",
+		"compression", "run", "length", "encoding", "bitmap",
+	};
+	int nwords = sizeof(words) / sizeof(words[0]);
+	int col = 0;
+
+	while (size > 0) {
+		const char *w = words[rnd() % nwords];
+		int len = strlen(w);
+
+		if (col + len + 1 > 72) {
+			putchar('\n');
+			col = 0;
+			--size;
+			continue;
+		}
+
+		if (col > 0) {
+			putchar(' ');
+			++col;
+			--size;
+		}
+
+		while (*w != '\0' && size > 0) {
+			putchar(*w++);
+			++col;
+			--size;
+		}
+	}
+}
+
+/*
+ * A raw PBM with filled rectangles, like the scanned line art and
+ * screen dumps packbits is used on.
+ */
+static void
+gen_pbm(long size)
+{
+	int width = 1024;
+	int rowbytes = width / 8;
+	int height = size / rowbytes;
+	unsigned char *bits;
+	int i, x, y;
+
+	bits = calloc((size_t)rowbytes * height, 1);
+	if (bits == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (i = 0; i < height / 4; ++i) {
+		int x0 = rnd() % width, y0 = rnd() % height;
+		int w = rnd() % 200, h = rnd() % 100;
+
+		for (y = y0; y < y0 + h && y < height; ++y)
+			for (x = x0; x < x0 + w && x < width; ++x)
+				bits[y * rowbytes + x / 8] ^= 0x80 >> (x % 8);
+	}
+
+	printf("P4\n%d %d\n", width, height);
+	fwrite(bits, rowbytes, height, stdout);
+	free(bits);
+}
+
+static void
+gen_mixed(long size)
+{
+	long chunk = 64 * 1024;
+
+	while (size > 0) {
+		long len = size < chunk ? size : chunk;
+
+		switch (rnd() % 3) {
+		case 0:
+			gen_zeros(len);
+			break;
+		case 1:
+			gen_random(len);
+			break;
+		case 2:
+			gen_text(len);
+			break;
+		}
+		size -= len;
+	}
+}
+
+/*
+ * Style sheets and terminal themes, colored the ways makemono
+ * understands, among lines it has to pass through untouched.
+ */
+static void
+gen_css(long size)
+{
+	static const char *props[] = {
+		"color", "background", "border-color", "outline-color",
+		"*.foreground", "*.background", "*.cursorColor",
+	};
+	int nprops = sizeof(props) / sizeof(props[0]);
+	char buf[128];
+	long rule = 0;
+
+	while (size > 0) {
+		const char *prop = props[rnd() % nprops];
+		ulong c = rnd() & 0xffffff;
+		int len;
+
+		switch (rnd() % 8) {
+		case 0:
+			len = sprintf(buf, "}\n\n.rule-%ld, #id-%ld > a {\n",
+			    rule, rule);
+			++rule;
+			break;
+		case 1:
+			len = sprintf(buf, "\t%s: #%03lx;\n", prop, c & 0xfff);
+			break;
+		case 2:
+			len = sprintf(buf, "\t%s: rgb(%lu, %lu, %lu);\n", prop,
+			    c >> 16, c >> 8 & 0xff, c & 0xff);
+			break;
+		case 3:
+			len = sprintf(buf, "\tborder: 1px solid #%06lx;\n", c);
+			break;
+		case 4:
+			len = sprintf(buf, "\tmargin: 0 auto; "
+			    "font: 12px/1.5 serif; transition: all 0.2s;\n");
+			break;
+		default:
+			len = sprintf(buf, "\t%s: #%06lx;\n", prop, c);
+			break;
+		}
+
+		if (len > size)
+			len = size;
+		fwrite(buf, 1, len, stdout);
+		size -= len;
+	}
+}
+
+/*
+ * Terminal, editor and toolkit themes: a few dozen colors used over
+ * and over in all the forms makemono knows.
+ */
+static void
+gen_theme(long size)
+{
+	ulong colors[32];
+	char buf[128];
+	int i, len;
+
+	for (i = 0; i < 32; ++i)
+		colors[i] = rnd() & 0xffffff;
+
+	while (size > 0) {
+		ulong c = colors[rnd() % 32];
+		int r = c >> 16, g = c >> 8 & 0xff, b = c & 0xff;
+
+		i = rnd() % 32;
+		switch (rnd() % 8) {
+		case 0:
+			len = sprintf(buf, "*.color%d: #%06lx\n", i, c);
+			break;
+		case 1:
+			len = sprintf(buf, "color%d rgb:%02x/%02x/%02x\n", i,
+			    r, g, b);
+			break;
+		case 2:
+			len = sprintf(buf, "\tbackground: rgba(%d, %d, %d, "
+			    "0.%d);\n", r, g, b, i % 10);
+			break;
+		case 3:
+			len = sprintf(buf, "\tcolor: #%06lx%02x;\n", c, i * 8);
+			break;
+		case 4:
+			len = sprintf(buf, "@define-color theme_color_%d "
+			    "hsl(%d, %d%%, %d%%);\n", i, (int)(c % 360),
+			    g * 100 / 255, b * 100 / 255);
+			break;
+		case 5:
+			len = sprintf(buf, "# palette entry %d, used by the "
+			    "status line\n", i);
+			break;
+		default:
+			len = sprintf(buf, "\tborder-color: rgb(%d, %d, %d);\n",
+			    r, g, b);
+			break;
+		}
+
+		if (len > size)
+			len = size;
+		fwrite(buf, 1, len, stdout);
+		size -= len;
+	}
+}
+
+/*
+ * Images take their size as WIDTHxHEIGHT and are written as raw PPM,
+ * threshold textures as raw PGM.
+ */
+static void
+gen_gradient(int width, int height)
+{
+	int x, y;
+
+	printf("P6\n%d %d\n255\n", width, height);
+	for (y = 0; y < height; ++y) {
+		for (x = 0; x < width; ++x) {
+			putchar(x * 255L / (width > 1 ? width - 1 : 1));
+			putchar(y * 255L / (height > 1 ? height - 1 : 1));
+			putchar((x + y) * 255L / (width + height));
+		}
+	}
+}
+
+static void
+gen_noise(int width, int height)
+{
+	long n = (long)width * height * 3;
+
+	printf("P6\n%d %d\n255\n", width, height);
+	while (n-- > 0)
+		putchar(rnd() & 0xff);
+}
+
+/*
+ * Something like a photo: smooth color fields from a coarse grid of
+ * random colors, a few soft edged discs and a little grain.
+ */
+#define GRID 6
+#define NDISCS 12
+
+static void
+gen_photo(int width, int height)
+{
+	int grid[GRID + 1][GRID + 1][3];
+	struct { long x, y, r; int c[3]; } discs[NDISCS];
+	int i, j, c, x, y;
+
+	for (i = 0; i <= GRID; ++i)
+		for (j = 0; j <= GRID; ++j)
+			for (c = 0; c < 3; ++c)
+				grid[i][j][c] = rnd() % 256;
+
+	for (i = 0; i < NDISCS; ++i) {
+		discs[i].x = rnd() % (width + 1);
+		discs[i].y = rnd() % (height + 1);
+		discs[i].r = rnd() % ((width < height ? width : height) / 4 + 1)
+		    + 1;
+		for (c = 0; c < 3; ++c)
+			discs[i].c[c] = rnd() % 256;
+	}
+
+	printf("P6\n%d %d\n255\n", width, height);
+	for (y = 0; y < height; ++y) {
+		/* Position in the grid in 1/256ths. */
+		long gy = (long)y * GRID * 256 / height;
+		int iy = gy / 256, fy = gy % 256;
+
+		for (x = 0; x < width; ++x) {
+			long gx = (long)x * GRID * 256 / width;
+			int ix = gx / 256, fx = gx % 256;
+			int grain = (int)(rnd() % 17) - 8;
+			int (*g0)[3] = grid[iy], (*g1)[3] = grid[iy + 1];
+			int v[3];
+
+			for (c = 0; c < 3; ++c) {
+				long top = g0[ix][c] * (256L - fx) +
+				    g0[ix + 1][c] * (long)fx;
+				long bottom = g1[ix][c] * (256L - fx) +
+				    g1[ix + 1][c] * (long)fx;
+
+				v[c] = (top * (256 - fy) + bottom * fy) >> 16;
+			}
+
+			for (i = 0; i < NDISCS; ++i) {
+				long dx = x - discs[i].x, dy = y - discs[i].y;
+				long r2 = discs[i].r * discs[i].r;
+				long d2 = dx * dx + dy * dy;
+				long a;
+
+				if (d2 >= r2)
+					continue;
+
+				/* Fade over the outer half of the radius. */
+				a = (r2 - d2) * 1024 / (3 * r2);
+				if (a > 256)
+					a = 256;
+				for (c = 0; c < 3; ++c)
+					v[c] += (discs[i].c[c] - v[c]) *
+					    a / 256;
+			}
+
+			for (c = 0; c < 3; ++c) {
+				int s = v[c] + grain;
+
+				putchar(s < 0 ? 0 : s > 255 ? 255 : s);
+			}
+		}
+	}
+}
+
+/*
+ * Blue noise threshold texture by void-and-cluster, written as a raw
+ * PGM of ranks scaled to 0..255. energy[] is the sum of a gaussian
+ * around every set pixel, wrapping at the edges, so the tightest
+ * cluster is the set pixel with the most energy and the largest void
+ * the unset pixel with the least.
+ */
+struct pattern {
+	int width, height, n;
+	uchar *set;
+	double *energy, *kernel;
+};
+
+static void
+toggle(struct pattern *p, int i)
+{
+	int sign = p->set[i] ? -1 : 1;
+	int x0 = i % p->width, y0 = i / p->width;
+	int x, y;
+
+	p->set[i] = !p->set[i];
+	for (y = 0; y < p->height; ++y) {
+		int dy = (y - y0 + p->height) % p->height;
+
+		for (x = 0; x < p->width; ++x) {
+			int dx = (x - x0 + p->width) % p->width;
+
+			p->energy[y * p->width + x] +=
+			    sign * p->kernel[dy * p->width + dx];
+		}
+	}
+}
+
+/* Set pixel with the most energy, or unset one with the least. */
+static int
+extreme(struct pattern *p, int set)
+{
+	int best = -1, i;
+
+	for (i = 0; i < p->n; ++i) {
+		if (p->set[i] != set)
+			continue;
+		if (best < 0 || (set ? p->energy[i] > p->energy[best] :
+		    p->energy[i] < p->energy[best]))
+			best = i;
+	}
+
+	return best;
+}
+
+static void
+reset(struct pattern *p, const uchar *set)
+{
+	int i;
+
+	memset(p->set, 0, p->n);
+	memset(p->energy, 0, p->n * sizeof(*p->energy));
+	for (i = 0; i < p->n; ++i)
+		if (set[i])
+			toggle(p, i);
+}
+
+static void
+gen_bluenoise(int width, int height)
+{
+	struct pattern p;
+	uchar *initial;
+	long *rank;
+	int nset = 0, i, k, x, y;
+
+	p.width = width;
+	p.height = height;
+	p.n = width * height;
+	p.set = calloc(p.n, 1);
+	p.energy = calloc(p.n, sizeof(*p.energy));
+	p.kernel = malloc(p.n * sizeof(*p.kernel));
+	initial = calloc(p.n, 1);
+	rank = malloc(p.n * sizeof(*rank));
+	if (!p.set || !p.energy || !p.kernel || !initial || !rank) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (y = 0; y < height; ++y) {
+		for (x = 0; x < width; ++x) {
+			int dx = x < width - x ? x : width - x;
+			int dy = y < height - y ? y : height - y;
+
+			p.kernel[y * width + x] =
+			    exp(-(dx * dx + dy * dy) / (2 * 1.5 * 1.5));
+		}
+	}
+
+	/* Random tenth of the pixels, relaxed until evenly spread. */
+	while (nset < p.n / 10 + 1) {
+		i = rnd() % p.n;
+		if (!p.set[i]) {
+			toggle(&p, i);
+			++nset;
+		}
+	}
+	for (;;) {
+		int cluster = extreme(&p, 1), cvoid;
+
+		toggle(&p, cluster);
+		cvoid = extreme(&p, 0);
+		toggle(&p, cvoid);
+		if (cvoid == cluster)
+			break;
+	}
+	memcpy(initial, p.set, p.n);
+
+	/* Ranks below the initial pattern: remove tightest clusters. */
+	for (k = nset - 1; k >= 0; --k) {
+		i = extreme(&p, 1);
+		toggle(&p, i);
+		rank[i] = k;
+	}
+
+	/* Above it: fill the largest voids. */
+	reset(&p, initial);
+	for (k = nset; k < p.n; ++k) {
+		i = extreme(&p, 0);
+		toggle(&p, i);
+		rank[i] = k;
+	}
+
+	printf("P5\n%d %d\n255\n", width, height);
+	for (i = 0; i < p.n; ++i)
+		putchar(rank[i] * 256 / p.n);
+
+	free(rank);
+	free(initial);
+	free(p.kernel);
+	free(p.energy);
+	free(p.set);
+}
+
+int
+main(int argc, char **argv)
+{
+	int width, height;
+	long size;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: gencorpus "
+		    "zeros|random|text|pbm|mixed|css|theme size\n"
+		    "       gencorpus gradient|noise|photo|bluenoise "
+		    "WIDTHxHEIGHT\n");
+		return 1;
+	}
+
+	if (sscanf(argv[2], "%dx%d", &width, &height) == 2) {
+		if (strcmp(argv[1], "gradient") == 0)
+			gen_gradient(width, height);
+		else if (strcmp(argv[1], "noise") == 0)
+			gen_noise(width, height);
+		else if (strcmp(argv[1], "photo") == 0)
+			gen_photo(width, height);
+		else if (strcmp(argv[1], "bluenoise") == 0)
+			gen_bluenoise(width, height);
+		else {
+			fprintf(stderr, "unknown image %s\n", argv[1]);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	size = atol(argv[2]);
+
+	if (strcmp(argv[1], "zeros") == 0)
+		gen_zeros(size);
+	else if (strcmp(argv[1], "random") == 0)
+		gen_random(size);
+	else if (strcmp(argv[1], "text") == 0)
+		gen_text(size);
+	else if (strcmp(argv[1], "pbm") == 0)
+		gen_pbm(size);
+	else if (strcmp(argv[1], "mixed") == 0)
+		gen_mixed(size);
+	else if (strcmp(argv[1], "css") == 0)
+		gen_css(size);
+	else if (strcmp(argv[1], "theme") == 0)
+		gen_theme(size);
+	else {
+		fprintf(stderr, "unknown corpus %s\n", argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
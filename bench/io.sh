@@ -0,0 +1,49 @@
+#! /bin/sh
+#
+# MB/s of copying a generated file a byte at a time with fgetc and
+# fputc against the reader and writer of common.h, from the file itself
+# and through a pipe. fread and block show what the copy costs without
+# looking at every byte. Every copy must equal its input.
+#
+
+size="${CORPUS_SIZE:-268435456}"
+iocopy="${IOCOPY:-./bench/iocopy}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$iocopy" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" mixed "$size" > "$tmpdir/in"
+mb=$(awk -v n="$size" 'BEGIN { print n / 1048576 }')
+
+printf "mode\tinput\twall_s\tmb_s\trss_kb\n"
+
+report() {
+    read -r wall rss < "$tmpdir/stat"
+    cmp -s "$tmpdir/in" "$tmpdir/out" || die "$1 $2: copy differs."
+    awk -v m="$1" -v i="$2" -v w="$wall" -v mb="$mb" -v r="$rss" \
+        'BEGIN { printf "%s\t%s\t%.3f\t%.1f\t%d\n", m, i,
+            w, (w > 0 ? mb / w : 0), r }'
+}
+
+for mode in fgetc reader fread block; do
+    "$runstat" -o "$tmpdir/stat" "$iocopy" "$mode" \
+        < "$tmpdir/in" > "$tmpdir/out"
+    report "$mode" file
+
+    "$runstat" -o "$tmpdir/stat" sh -c \
+        'cat "$1/in" | "$2" "$3" > "$1/out"' sh "$tmpdir" "$iocopy" "$mode"
+    report "$mode" pipe
+done
@@ -0,0 +1,101 @@
+/*
+ * Copy stdin to stdout a byte at a time the way the tools used to,
+ * with fgetc and fputc, and the way they do now, with the reader and
+ * writer of common.h. The block modes copy without looking at bytes,
+ * for what the i/o itself costs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "common.h"
+
+static void
+copy_fgetc(void)
+{
+	int ch;
+
+	while ((ch = fgetc(stdin)) != EOF)
+		if (fputc(ch, stdout) == EOF)
+			die("fputc:");
+	if (ferror(stdin))
+		die("fgetc:");
+}
+
+static void
+copy_fread(void)
+{
+	static char buf[65536];
+	size_t n;
+
+	while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0)
+		if (fwrite(buf, 1, n, stdout) != n)
+			die("fwrite:");
+	if (ferror(stdin))
+		die("fread:");
+}
+
+static void
+copy_reader(struct reader *in, struct writer *out)
+{
+	int ch;
+
+	while ((ch = READ_BYTE(in)) != EOF)
+		WRITE_BYTE(out, ch);
+}
+
+static void
+copy_block(struct reader *in, struct writer *out)
+{
+	size_t n;
+
+	while ((n = reader_fill(in, READER_BUFSIZE)) > 0) {
+		writer_write(out, in->buf + in->pos, n);
+		in->pos += n;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct reader in;
+	struct writer out;
+	int error;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: iocopy fgetc|fread|reader|block "
+		    "< in > out\n");
+		return 1;
+	}
+
+	if (strcmp(argv[1], "fgetc") == 0) {
+		copy_fgetc();
+		if (fflush(stdout) != 0)
+			die("fflush:");
+		return 0;
+	}
+	if (strcmp(argv[1], "fread") == 0) {
+		copy_fread();
+		if (fflush(stdout) != 0)
+			die("fflush:");
+		return 0;
+	}
+
+	reader_init(&in, STDIN_FILENO, "stdin");
+	writer_init(&out, STDOUT_FILENO, "stdout");
+	if (strcmp(argv[1], "reader") == 0)
+		copy_reader(&in, &out);
+	else if (strcmp(argv[1], "block") == 0)
+		copy_block(&in, &out);
+	else
+		die("%s: unknown mode.", argv[1]);
+
+	if ((error = reader_close(&in)) != 0)
+		die("stdin: %s", strerror(error));
+	if ((error = writer_close(&out)) != 0)
+		die("stdout: %s", strerror(error));
+
+	return 0;
+}
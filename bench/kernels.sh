@@ -0,0 +1,49 @@
+#! /bin/sh
+#
+# Mpixel/s of every atkinson error diffusion kernel, with and without
+# serpentine scanning. Set REF to an older atkinson binary to time its
+# hand-written loop alongside.
+#
+
+size="${SIZE:-8192x8192}"
+atkinson="${ATKINSON:-./atkinson}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+ref="${REF:-}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$atkinson" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" gradient "$size" > "$tmpdir/in.ppm"
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+
+# label, command...
+run() {
+    label=$1
+    shift
+    "$runstat" -o "$tmpdir/stat" "$@" < "$tmpdir/in.ppm" > /dev/null
+    read -r wall rss < "$tmpdir/stat"
+    awk -v l="$label" -v w="$wall" -v mp="$mpixels" \
+        'BEGIN { printf "%s\t%.3f\t%.1f\n", l, w, mp / w }'
+}
+
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "kernel\twall_s\tmpixel_s\n"
+
+[ -z "$ref" ] || run reference "$ref"
+
+for kernel in atkinson floyd jarvis stucki sierra; do
+    run "$kernel" "$atkinson" -k "$kernel"
+    run "$kernel-s" "$atkinson" -k "$kernel" -s
+done
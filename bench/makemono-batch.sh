@@ -0,0 +1,70 @@
+#! /bin/sh
+#
+# Files/s and MB/s of makemono converting a directory of generated
+# themes into another, one process per file from a shell loop against
+# batch mode with 1 up to JOBS workers. All must give the same files.
+#
+
+nfiles="${NFILES:-2000}"
+jobs="${JOBS:-$(getconf _NPROCESSORS_ONLN)}"
+makemono="${MAKEMONO:-./makemono}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$makemono" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+# Sizes from 1 to 64 KiB, half style sheets and half themes.
+mkdir "$tmpdir/in"
+i=0
+while [ "$i" -lt "$nfiles" ]; do
+    kind=css
+    [ $((i % 2)) -eq 0 ] && kind=theme
+    "$gencorpus" "$kind" $(((i * 7919 % 64 + 1) * 1024)) \
+        > "$tmpdir/in/$i.$kind"
+    i=$((i + 1))
+done
+mb=$(du -sk "$tmpdir/in" | awk '{ print $1 / 1024 }')
+
+printf "%s files, %s MB\n" "$nfiles" "$mb"
+printf "mode\twall_s\tfiles_s\tmb_s\n"
+
+report() {
+    read -r wall rss < "$tmpdir/stat"
+    awk -v m="$1" -v w="$wall" -v n="$nfiles" -v mb="$mb" \
+        'BEGIN { printf "%s\t%.3f\t%.0f\t%.1f\n", m, w, n / w, mb / w }'
+}
+
+mkdir "$tmpdir/loop"
+"$runstat" -o "$tmpdir/stat" sh -c '
+    for f in "$2"/in/*; do
+        "$1" -a < "$f" > "$2/loop/${f##*/}" || exit 1
+    done' sh "$makemono" "$tmpdir"
+report loop
+
+j=1
+while [ "$j" -le "$jobs" ]; do
+    rm -rf "$tmpdir/out"
+    "$runstat" -o "$tmpdir/stat" "$makemono" -a -j "$j" \
+        -o "$tmpdir/out" "$tmpdir/in"
+    report "-j $j"
+    diff -r "$tmpdir/loop" "$tmpdir/out" > /dev/null ||
+        die "-j $j: output differs."
+    # Doubling, ending with $jobs itself.
+    if [ "$j" -lt "$jobs" ] && [ $((j * 2)) -gt "$jobs" ]; then
+        j=$jobs
+    else
+        j=$((j * 2))
+    fi
+done
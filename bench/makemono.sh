@@ -0,0 +1,50 @@
+#! /bin/sh
+#
+# MB/s of makemono in each hue over generated style sheets and over
+# themes that reuse a few colors in every syntax, as is and minified to
+# one line. Both must give the same colors.
+#
+
+size="${SIZE:-67108864}"
+makemono="${MAKEMONO:-./makemono}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$makemono" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+mb=$(awk -v b="$size" 'BEGIN { print b / 1048576 }')
+
+printf "%s MB\n" "$mb"
+printf "corpus\tinput\thue\twall_s\tmb_s\trss_kb\n"
+
+for corpus in css theme; do
+    "$gencorpus" "$corpus" "$size" > "$tmpdir/lines.in"
+    tr '\n' ' ' < "$tmpdir/lines.in" > "$tmpdir/oneline.in"
+    for hue in w a c g; do
+        for input in lines oneline; do
+            "$runstat" -o "$tmpdir/stat" "$makemono" "-$hue" \
+                < "$tmpdir/$input.in" > "$tmpdir/$input.out"
+            read -r wall rss < "$tmpdir/stat"
+            awk -v c="$corpus" -v i="$input" -v h="$hue" -v w="$wall" \
+                -v mb="$mb" -v r="$rss" 'BEGIN {
+                printf "%s\t%s\t%s\t%.3f\t%.1f\t%d\n",
+                    c, i, h, w, mb / w, r
+            }'
+        done
+        tr '\n' ' ' < "$tmpdir/lines.out" |
+            cmp -s - "$tmpdir/oneline.out" ||
+            die "$corpus -$hue: one line output differs."
+    done
+done
@@ -0,0 +1,49 @@
+#! /bin/sh
+#
+# Time a bayer to atkinson chain as a shell pipeline of the two tools
+# against the same stages in one imgpipe process, with and without a
+# thread per stage. All must give the same output.
+#
+
+size="${SIZE:-8192x8192}"
+atkinson="${ATKINSON:-./atkinson}"
+bayer="${BAYER:-./bayer}"
+imgpipe="${IMGPIPE:-./imgpipe}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$atkinson" "$bayer" "$imgpipe" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" gradient "$size" > "$tmpdir/in.ppm"
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "chain\twall_s\tmpixel_s\n"
+
+run() {
+    name="$1"
+    shift
+    "$runstat" -o "$tmpdir/stat" "$@" < "$tmpdir/in.ppm" > "$tmpdir/out.pbm"
+    read -r wall rss < "$tmpdir/stat"
+    awk -v n="$name" -v w="$wall" -v mp="$mpixels" \
+        'BEGIN { printf "%s\t%.3f\t%.1f\n", n, w, mp / w }'
+    sum=$(cksum < "$tmpdir/out.pbm")
+    [ -n "${ref:-}" ] || ref="$sum"
+    [ "$sum" = "$ref" ] || die "$name: output differs."
+}
+
+run shell sh -c "\"$bayer\" -p cga | \"$atkinson\" -k floyd"
+run imgpipe "$imgpipe" bayer=cga gray diffuse=floyd
+run imgpipe-t "$imgpipe" -t bayer=cga gray diffuse=floyd
@@ -0,0 +1,59 @@
+#! /bin/sh
+#
+# Compare end-to-end wall time of atkinson and bayer with the raw
+# reader/writer against going through libnetpbm (-n), from a file
+# (mapped) and from a pipe.
+#
+
+size="${SIZE:-8192x8192}"
+atkinson="${ATKINSON:-./atkinson}"
+bayer="${BAYER:-./bayer}"
+runstat="${RUNSTAT:-./bench/runstat}"
+gencorpus="${GENCORPUS:-./bench/gencorpus}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$atkinson" "$bayer" "$runstat" "$gencorpus"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+"$gencorpus" gradient "$size" > "$tmpdir/in.ppm"
+mpixels=$(echo "$size" | awk -Fx '{ print $1 * $2 / 1e6 }')
+
+printf "%s (%s Mpixel)\n" "$size" "$mpixels"
+printf "tool\tpath\tinput\twall_s\tmpixel_s\trss_kb\n"
+
+for tool in "$atkinson" "$bayer"; do
+    ref=""
+    for path in netpbm raw; do
+        flag=""
+        [ "$path" = netpbm ] && flag="-n"
+        for input in file pipe; do
+            if [ "$input" = file ]; then
+                "$runstat" -o "$tmpdir/stat" "$tool" $flag \
+                    < "$tmpdir/in.ppm" > "$tmpdir/out"
+            else
+                cat "$tmpdir/in.ppm" | "$runstat" -o "$tmpdir/stat" \
+                    "$tool" $flag > "$tmpdir/out"
+            fi
+            read -r wall rss < "$tmpdir/stat"
+
+            sum=$(cksum < "$tmpdir/out")
+            [ -n "$ref" ] || ref="$sum"
+            [ "$sum" = "$ref" ] || die "$tool: $path output differs."
+
+            awk -v t="${tool##*/}" -v p="$path" -v i="$input" \
+                -v w="$wall" -v mp="$mpixels" -v r="$rss" 'BEGIN {
+                printf "%s\t%s\t%s\t%.3f\t%.1f\t%d\n", t, p, i, w, mp / w, r
+            }'
+        done
+    done
+done
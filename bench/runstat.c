@@ -0,0 +1,75 @@
+/*
+ * Run a command and report its wall time and peak resident set size.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static double
+now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct rusage ru;
+	FILE *out = stderr;
+	double start;
+	pid_t pid;
+	int status;
+
+	if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+		out = fopen(argv[2], "w");
+		if (out == NULL) {
+			perror(argv[2]);
+			return 1;
+		}
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: runstat [-o file] command [args...]\n");
+		return 1;
+	}
+
+	start = now();
+
+	pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		return 1;
+	}
+
+	if (pid == 0) {
+		execvp(argv[1], argv + 1);
+		perror(argv[1]);
+		_exit(127);
+	}
+
+	if (wait4(pid, &status, 0, &ru) == -1) {
+		perror("wait4");
+		return 1;
+	}
+
+	/* wall seconds, peak rss in kilobytes */
+	fprintf(out, "%.6f %ld\n", now() - start, ru.ru_maxrss);
+	if (out != stderr)
+		fclose(out);
+
+	if (WIFEXITED(status))
+		return WEXITSTATUS(status);
+
+	return 1;
+}
@@ -0,0 +1,71 @@
+#! /bin/sh
+#
+# Addresses/s of ula -n against running it once per address from a
+# shell loop, and subnets/s allocating unique subnets from a bitmap
+# and from a hash set. Also checks every address is well formed and
+# every subnet is unique.
+#
+
+count="${COUNT:-10000000}"
+subnets="${SUBNETS:-1000000}"
+loops="${LOOPS:-1000}"
+ula="${ULA:-./ula}"
+runstat="${RUNSTAT:-./bench/runstat}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+for prg in "$ula" "$runstat"; do
+    [ -x "$prg" ] || die "$prg not found, run make first."
+done
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+printf "mode\tcount\twall_s\taddr_s\n"
+
+report() {
+    read -r wall rss < "$tmpdir/stat"
+    awk -v m="$1" -v n="$2" -v w="$wall" \
+        'BEGIN { printf "%s\t%d\t%.3f\t%.0f\n", m, n, w, n / w }'
+}
+
+check() {
+    awk -v n="$2" '
+    /^(10|172|192)\.[0-9]+\.[0-9]+\.[0-9]+\/(8|12|16)$/ { ok++; next }
+    /^fd[0-9a-f][0-9a-f](:[0-9a-f]+)+\/64$/ && split($0, g, ":") == 8 {
+        ok++
+        next
+    }
+    END { exit !(ok == n && NR == n) }' "$tmpdir/out" ||
+        die "$1: bad output."
+}
+
+"$runstat" -o "$tmpdir/stat" sh -c '
+    i=0
+    while [ "$i" -lt "$2" ]; do
+        "$1" -6 || exit 1
+        i=$((i + 1))
+    done' sh "$ula" "$loops" > "$tmpdir/out"
+report loop "$loops"
+check loop "$loops"
+
+for flag in -4 -6; do
+    "$runstat" -o "$tmpdir/stat" "$ula" "$flag" -n "$count" > "$tmpdir/out"
+    report "$flag -n" "$count"
+    check "$flag" "$count"
+done
+
+for pool in "10.0.0.0/8 -l 32" "fd00::/16 -l 64"; do
+    "$runstat" -o "$tmpdir/stat" "$ula" -p $pool -n "$subnets" \
+        > "$tmpdir/out"
+    report "-p $pool" "$subnets"
+    [ "$(wc -l < "$tmpdir/out")" -eq "$subnets" ] ||
+        die "-p $pool: short output."
+    [ -z "$(sort "$tmpdir/out" | uniq -d | head -1)" ] ||
+        die "-p $pool: duplicate subnets."
+done
@@ -0,0 +1,275 @@
+/*
+ * Bitrate statistics of a video from its packet list, see packets.h.
+ * Prints a summary and optionally writes a histogram of the number of
+ * seconds per bitrate for gnuplot.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "packets.h"
+
+/* What tocd encodes for, a double speed cdrom. */
+#define MAXRATE_K 2000
+#define BUFSIZE_K (384 * 8)
+#define BINWIDTH 50
+
+/*
+ * Bytes per second of video, from the time of the first packet. Only
+ * seconds that have packets count in the histogram, as in the awk
+ * version this replaces.
+ */
+struct seconds {
+	unsigned long *bytes;
+	unsigned char *seen;
+	long n, max;
+	double total;
+	long packets;
+};
+
+static void *
+xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return ptr;
+}
+
+static void
+add_packet(struct seconds *s, long sec, long size)
+{
+	if (sec >= s->max) {
+		long max = s->max ? s->max : 4096;
+
+		while (sec >= max)
+			max *= 2;
+		s->bytes = xrealloc(s->bytes, max * sizeof(*s->bytes));
+		s->seen = xrealloc(s->seen, max);
+		memset(s->bytes + s->max, 0,
+		    (max - s->max) * sizeof(*s->bytes));
+		memset(s->seen + s->max, 0, max - s->max);
+		s->max = max;
+	}
+	if (sec >= s->n)
+		s->n = sec + 1;
+
+	s->bytes[sec] += size;
+	s->seen[sec] = 1;
+	s->total += size;
+	++s->packets;
+}
+
+/*
+ * Packets before the first one, B-frames shown earlier than it was
+ * decoded, count in the first second.
+ */
+static void
+read_packets(struct seconds *s, FILE *fp, const char *name)
+{
+	static struct packet_reader pr;
+	struct packet pkt;
+	double t0 = 0;
+
+	packet_init(&pr, fp);
+	while (packet_read(&pr, &pkt)) {
+		double sec;
+
+		if (s->packets == 0)
+			t0 = pkt.time;
+		sec = (pkt.time - t0) / 1000000;
+		add_packet(s, sec > 0 ? (long)sec : 0, pkt.size);
+	}
+
+	if (ferror(fp)) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	if (pr.skipped > 0)
+		fprintf(stderr, "%s: skipped %ld of %ld lines.\n", name,
+		    pr.skipped, pr.lines);
+}
+
+static double
+kbits(unsigned long bytes)
+{
+	return bytes * 8 / 1000.0;
+}
+
+static void
+write_histogram(const struct seconds *s, const char *path, int binwidth)
+{
+	long *count = NULL;
+	long nbins = 0, sec, i;
+	FILE *fp;
+
+	for (sec = 0; sec < s->n; ++sec) {
+		long bin;
+
+		if (!s->seen[sec])
+			continue;
+
+		bin = (long)(kbits(s->bytes[sec]) / binwidth);
+		if (bin >= nbins) {
+			count = xrealloc(count, (bin + 1) * sizeof(*count));
+			memset(count + nbins, 0,
+			    (bin + 1 - nbins) * sizeof(*count));
+			nbins = bin + 1;
+		}
+		++count[bin];
+	}
+
+	if ((fp = fopen(path, "w")) == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < nbins; ++i)
+		if (count[i] > 0)
+			fprintf(fp, "%ld %ld\n",
+			    (long)(i * binwidth + binwidth / 2.0), count[i]);
+	if (fclose(fp) != 0) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	free(count);
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Nearest rank percentile of sorted values.
+ */
+static double
+percentile(const double *sorted, long n, int p)
+{
+	long rank = (n * p + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*
+ * The buffer check runs per second: whatever goes over maxrate has to
+ * come out of the buffer, and is paid back in seconds below it.
+ */
+static void
+print_stats(const struct seconds *s, int maxrate, int bufsize)
+{
+	double *sorted, peak = 0, level = 0, maxlevel = 0;
+	long peak_sec = 0, level_sec = 0, over = 0, sec;
+
+	sorted = xrealloc(NULL, s->n * sizeof(*sorted));
+	for (sec = 0; sec < s->n; ++sec) {
+		double kb = kbits(s->bytes[sec]);
+
+		sorted[sec] = kb;
+		if (kb > peak) {
+			peak = kb;
+			peak_sec = sec;
+		}
+
+		level += kb - maxrate;
+		if (level < 0)
+			level = 0;
+		if (level > maxlevel) {
+			maxlevel = level;
+			level_sec = sec;
+		}
+		if (level > bufsize)
+			++over;
+	}
+	qsort(sorted, s->n, sizeof(*sorted), compare_double);
+
+	printf("packets     %ld\n", s->packets);
+	printf("duration    %ld s\n", s->n);
+	printf("size        %.0f bytes\n", s->total);
+	printf("mean        %.0f kbit/s\n", s->total * 8 / 1000 / s->n);
+	printf("peak        %.0f kbit/s at %ld s\n", peak, peak_sec);
+	printf("p50         %.0f kbit/s\n", percentile(sorted, s->n, 50));
+	printf("p90         %.0f kbit/s\n", percentile(sorted, s->n, 90));
+	printf("p99         %.0f kbit/s\n", percentile(sorted, s->n, 99));
+	printf("maxrate     %d kbit/s\n", maxrate);
+	printf("buffer      %d kbit\n", bufsize);
+	printf("buffer use  %.0f kbit (%.0f%%) at %ld s\n", maxlevel,
+	    maxlevel * 100 / bufsize, level_sec);
+	printf("over buffer %ld s\n", over);
+
+	free(sorted);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: bitrate [-b bufsize_k] [-m maxrate_k] "
+	    "[-o histogram] [-w binwidth]\n"
+	    "               [packets.csv]\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct seconds s;
+	const char *histogram = NULL;
+	int maxrate = MAXRATE_K, bufsize = BUFSIZE_K, binwidth = BINWIDTH;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "b:m:o:w:")) != -1) {
+		switch (ch) {
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		case 'm':
+			maxrate = atoi(optarg);
+			break;
+		case 'o':
+			histogram = optarg;
+			break;
+		case 'w':
+			binwidth = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1 || bufsize < 1 || maxrate < 1 || binwidth < 1)
+		usage();
+
+	memset(&s, 0, sizeof(s));
+	if (argc == 1) {
+		FILE *fp;
+
+		if ((fp = fopen(argv[0], "r")) == NULL) {
+			perror(argv[0]);
+			return EXIT_FAILURE;
+		}
+		read_packets(&s, fp, argv[0]);
+		fclose(fp);
+	} else
+		read_packets(&s, stdin, "stdin");
+
+	if (s.packets == 0) {
+		fprintf(stderr, "no packets found.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (histogram != NULL)
+		write_histogram(&s, histogram, binwidth);
+	print_stats(&s, maxrate, bufsize);
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include <math.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "colorspace.h"
+
+/*
+ * Luminance weights in 16 bit fixed point: for every 8-bit x,
+ * x * LUMA_R >> 16 == x * 21 / 100 and likewise for 72 and 7, so
+ * the fast path matches the exact formula bit for bit.
+ */
+#define LUMA_R 13763
+#define LUMA_G 47186
+#define LUMA_B 4588
+
+static const char *names[] = { "rgb", "lab", "oklab" };
+
+/* sRGB samples to linear light. */
+static double linear[256];
+
+void
+colorspace_init(void)
+{
+	int i;
+
+	for (i = 0; i < 256; ++i) {
+		double v = i / 255.0;
+
+		linear[i] = v <= 0.04045 ? v / 12.92 :
+		    pow((v + 0.055) / 1.055, 2.4);
+	}
+}
+
+/*
+ * Returns the colorspace called name, or -1 when there is none.
+ */
+int
+colorspace_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); ++i)
+		if (strcmp(names[i], name) == 0)
+			return i;
+
+	return -1;
+}
+
+static double
+cube_root(double v)
+{
+	return v > 0 ? pow(v, 1.0 / 3) : 0;
+}
+
+/* CIE L*a*b* with a D65 white point. */
+static void
+to_lab(double r, double g, double b, double *out)
+{
+	double xyz[3], f[3];
+	int i;
+
+	xyz[0] = (0.4124564 * r + 0.3575761 * g + 0.1804375 * b) / 0.95047;
+	xyz[1] = 0.2126729 * r + 0.7151522 * g + 0.0721750 * b;
+	xyz[2] = (0.0193339 * r + 0.1191920 * g + 0.9503041 * b) / 1.08883;
+
+	for (i = 0; i < 3; ++i) {
+		if (xyz[i] > 216.0 / 24389)
+			f[i] = cube_root(xyz[i]);
+		else
+			f[i] = xyz[i] * 24389 / 27 / 116 + 16.0 / 116;
+	}
+
+	out[0] = 116 * f[1] - 16;
+	out[1] = 500 * (f[0] - f[1]);
+	out[2] = 200 * (f[1] - f[2]);
+}
+
+/* Bjorn Ottosson's OKLab, scaled so L runs from 0 to 100 like L*. */
+static void
+to_oklab(double r, double g, double b, double *out)
+{
+	double l, m, s;
+
+	l = cube_root(0.4122214708 * r + 0.5363325363 * g + 0.0514459929 * b);
+	m = cube_root(0.2119034982 * r + 0.6806995451 * g + 0.1073969566 * b);
+	s = cube_root(0.0883024619 * r + 0.2817188376 * g + 0.6299787005 * b);
+
+	out[0] = 100 * (0.2104542553 * l + 0.7936177850 * m - 0.0040720468 * s);
+	out[1] = 100 * (1.9779984951 * l - 2.4285922050 * m + 0.4505937099 * s);
+	out[2] = 100 * (0.0259040371 * l + 0.7827717662 * m - 0.8086757660 * s);
+}
+
+/*
+ * Convert an 8-bit sRGB color to space. COLOR_RGB just copies it.
+ */
+void
+colorspace_convert(int space, const int *rgb, double *out)
+{
+	double r = linear[rgb[0]], g = linear[rgb[1]], b = linear[rgb[2]];
+
+	switch (space) {
+	case COLOR_LAB:
+		to_lab(r, g, b, out);
+		break;
+	case COLOR_OKLAB:
+		to_oklab(r, g, b, out);
+		break;
+	default:
+		out[0] = rgb[0];
+		out[1] = rgb[1];
+		out[2] = rgb[2];
+		break;
+	}
+}
+
+/*
+ * Luminance of a row of 8-bit red, green and blue planes, as used by
+ * atkinson: 21% red, 72% green and 7% blue.
+ */
+void
+colorspace_luma_row(const unsigned char *r, const unsigned char *g,
+    const unsigned char *b, unsigned short *gray, int width)
+{
+	int x = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i wr = _mm_set1_epi16((short)LUMA_R);
+	const __m128i wg = _mm_set1_epi16((short)LUMA_G);
+	const __m128i wb = _mm_set1_epi16((short)LUMA_B);
+
+	for (; x + 16 <= width; x += 16) {
+		__m128i vr = _mm_loadu_si128((const __m128i *)(r + x));
+		__m128i vg = _mm_loadu_si128((const __m128i *)(g + x));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+		__m128i lo, hi;
+
+		lo = _mm_add_epi16(
+		    _mm_mulhi_epu16(_mm_unpacklo_epi8(vr, zero), wr),
+		    _mm_mulhi_epu16(_mm_unpacklo_epi8(vg, zero), wg));
+		lo = _mm_add_epi16(lo,
+		    _mm_mulhi_epu16(_mm_unpacklo_epi8(vb, zero), wb));
+
+		hi = _mm_add_epi16(
+		    _mm_mulhi_epu16(_mm_unpackhi_epi8(vr, zero), wr),
+		    _mm_mulhi_epu16(_mm_unpackhi_epi8(vg, zero), wg));
+		hi = _mm_add_epi16(hi,
+		    _mm_mulhi_epu16(_mm_unpackhi_epi8(vb, zero), wb));
+
+		_mm_storeu_si128((__m128i *)(gray + x), lo);
+		_mm_storeu_si128((__m128i *)(gray + x + 8), hi);
+	}
+#endif
+	for (; x < width; ++x) {
+		gray[x] = (r[x] * (long)LUMA_R >> 16) +
+		    (g[x] * (long)LUMA_G >> 16) +
+		    (b[x] * (long)LUMA_B >> 16);
+	}
+}
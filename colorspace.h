@@ -0,0 +1,17 @@
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+/*
+ * Conversion of 8-bit sRGB colors to perceptual color spaces, where
+ * the euclidean distance between two colors follows how different
+ * they look.
+ */
+enum colorspace { COLOR_RGB, COLOR_LAB, COLOR_OKLAB };
+
+void colorspace_init(void);
+int colorspace_find(const char *);
+void colorspace_convert(int, const int *, double *);
+void colorspace_luma_row(const unsigned char *, const unsigned char *,
+    const unsigned char *, unsigned short *, int);
+
+#endif
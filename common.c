@@ -0,0 +1,392 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+
+#define PAGESIZE 4096
+
+void
+die(const char *fmt, ...)
+{
+	va_list ap;
+	int saved = errno;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	if (fmt[0] != '\0' && fmt[strlen(fmt) - 1] == ':')
+		fprintf(stderr, " %s\n", strerror(saved));
+	else
+		fputc('\n', stderr);
+
+	exit(1);
+}
+
+void *
+xmalloc(size_t size)
+{
+	void *ptr;
+
+	ptr = malloc(size);
+	if (ptr == NULL)
+		die("malloc:");
+
+	return ptr;
+}
+
+void *
+xcalloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	ptr = calloc(nmemb, size);
+	if (ptr == NULL)
+		die("calloc:");
+
+	return ptr;
+}
+
+void *
+xrealloc(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (ptr == NULL)
+		die("realloc:");
+
+	return ptr;
+}
+
+FILE *
+xfopen(const char *pathname, const char *mode)
+{
+	FILE *f;
+
+	f = fopen(pathname, mode);
+	if (f == NULL)
+		die("fopen: %s:", pathname);
+
+	return f;
+}
+
+static unsigned char *
+alloc_aligned(size_t size)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, PAGESIZE, size) != 0)
+		die("posix_memalign: out of memory.");
+
+	return ptr;
+}
+
+/*
+ * Small files get a buffer that fits them, so converting many of them
+ * does not touch a fresh READER_BUFSIZE each time. It is at least a
+ * page, as files in /proc and /sys or ones that grow may be bigger
+ * than they say. Only files read from the start are mapped, a file
+ * that was partly read already, like an inherited stdin, is read on
+ * from where it is.
+ */
+void
+reader_init(struct reader *r, int fd, const char *name)
+{
+	struct stat st;
+	size_t size = READER_BUFSIZE;
+	off_t off;
+
+	memset(r, 0, sizeof(*r));
+	r->name = name;
+	r->fd = fd;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    (off = lseek(fd, 0, SEEK_CUR)) != -1) {
+		off_t left = st.st_size > off ? st.st_size - off : 0;
+
+		if (off == 0 && st.st_size >= READER_BUFSIZE) {
+			void *map;
+
+			map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			    fd, 0);
+			if (map != MAP_FAILED) {
+				madvise(map, st.st_size, MADV_SEQUENTIAL);
+				r->buf = map;
+				r->size = r->len = r->maplen = st.st_size;
+				r->nread = st.st_size;
+				r->eof = 1;
+				return;
+			}
+		}
+		if (left < READER_BUFSIZE)
+			size = left + 1 > PAGESIZE ? left + 1 : PAGESIZE;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	r->size = READER_PUSHBACK + size;
+	r->buf = r->alloc = alloc_aligned(r->size);
+	r->pos = r->len = READER_PUSHBACK;
+}
+
+int
+reader_open(struct reader *r, const char *path)
+{
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		memset(r, 0, sizeof(*r));
+		r->name = path;
+		r->fd = -1;
+		r->error = errno;
+		return r->error;
+	}
+	reader_init(r, fd, path);
+
+	return 0;
+}
+
+/*
+ * Read until at least want bytes are buffered, or as many as fit, or
+ * the input ends. Returns the number of bytes buffered.
+ */
+size_t
+reader_fill(struct reader *r, size_t want)
+{
+	if (want > r->size - READER_PUSHBACK)
+		want = r->size - READER_PUSHBACK;
+
+	while (r->len - r->pos < want && !r->eof) {
+		size_t keep = r->pos < READER_PUSHBACK ? r->pos :
+		    READER_PUSHBACK;
+		ssize_t n;
+
+		if (r->pos > READER_PUSHBACK) {
+			memmove(r->buf + READER_PUSHBACK - keep,
+			    r->buf + r->pos - keep, r->len - r->pos + keep);
+			r->len -= r->pos - READER_PUSHBACK;
+			r->pos = READER_PUSHBACK;
+		}
+
+		n = read(r->fd, r->buf + r->len, r->size - r->len);
+		if (n > 0) {
+			r->len += n;
+			r->nread += n;
+		} else if (n == 0)
+			r->eof = 1;
+		else if (errno != EINTR) {
+			r->error = errno;
+			r->eof = 1;
+		}
+	}
+
+	return r->len - r->pos;
+}
+
+/*
+ * READ_BYTE() once the buffer is empty.
+ */
+int
+reader_refill(struct reader *r)
+{
+	if (reader_fill(r, 1) == 0)
+		return EOF;
+
+	return r->buf[r->pos++];
+}
+
+/*
+ * Closes the file unless it is stdin, returns the error if there was
+ * one.
+ */
+int
+reader_close(struct reader *r)
+{
+	if (r->maplen > 0)
+		munmap(r->buf, r->maplen);
+	free(r->alloc);
+	if (r->fd > STDIN_FILENO)
+		close(r->fd);
+	r->buf = r->alloc = NULL;
+
+	return r->error;
+}
+
+void
+writer_init(struct writer *w, int fd, const char *name)
+{
+	w->name = name;
+	w->fd = fd;
+	w->buf = alloc_aligned(WRITER_BUFSIZE);
+	w->len = 0;
+	w->nwritten = 0;
+	w->error = 0;
+}
+
+int
+writer_open(struct writer *w, const char *path)
+{
+	int fd;
+
+	if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+		w->name = path;
+		w->fd = -1;
+		w->buf = NULL;
+		w->len = 0;
+		w->error = errno;
+		return w->error;
+	}
+	writer_init(w, fd, path);
+
+	return 0;
+}
+
+static void
+write_all(struct writer *w, const void *ptr, size_t len)
+{
+	const char *p = ptr;
+
+	while (len > 0 && w->error == 0) {
+		ssize_t n = write(w->fd, p, len);
+
+		if (n >= 0) {
+			p += n;
+			len -= n;
+			w->nwritten += n;
+		} else if (errno != EINTR)
+			w->error = errno;
+	}
+}
+
+void
+writer_write(struct writer *w, const void *ptr, size_t len)
+{
+	if (w->len + len > WRITER_BUFSIZE) {
+		writer_flush(w);
+		if (len >= WRITER_BUFSIZE) {
+			write_all(w, ptr, len);
+			return;
+		}
+	}
+
+	memcpy(w->buf + w->len, ptr, len);
+	w->len += len;
+}
+
+/*
+ * WRITE_BYTE() once the buffer is full.
+ */
+void
+writer_putc(struct writer *w, int c)
+{
+	if (w->len == WRITER_BUFSIZE)
+		writer_flush(w);
+	w->buf[w->len++] = c;
+}
+
+int
+writer_flush(struct writer *w)
+{
+	write_all(w, w->buf, w->len);
+	w->len = 0;
+
+	return w->error;
+}
+
+/*
+ * Flushes and closes the file unless it is stdout or stderr, returns
+ * the error if there was one.
+ */
+int
+writer_close(struct writer *w)
+{
+	if (w->buf != NULL)
+		writer_flush(w);
+	free(w->buf);
+	w->buf = NULL;
+	if (w->fd > STDERR_FILENO && close(w->fd) != 0 && w->error == 0)
+		w->error = errno;
+
+	return w->error;
+}
+
+/*
+ * Blocks start with a link to the previous one, padded so what follows
+ * is aligned for anything.
+ */
+union align {
+	long l;
+	double d;
+	void *p;
+};
+
+struct arena_block {
+	struct arena_block *next;
+	union align align;
+};
+
+#define ALIGN sizeof(union align)
+#define HEADER offsetof(struct arena_block, align)
+
+void
+arena_init(struct arena *a)
+{
+	a->blocks = NULL;
+	a->pos = NULL;
+	a->left = 0;
+}
+
+void *
+arena_alloc(struct arena *a, size_t size)
+{
+	void *ptr;
+
+	size = (size + ALIGN - 1) / ALIGN * ALIGN;
+	if (size > a->left) {
+		size_t blocksize = HEADER + size;
+		struct arena_block *block;
+
+		if (blocksize < ARENA_BLOCKSIZE)
+			blocksize = ARENA_BLOCKSIZE;
+		block = xmalloc(blocksize);
+		block->next = a->blocks;
+		a->blocks = block;
+		a->pos = (char *)block + HEADER;
+		a->left = blocksize - HEADER;
+	}
+
+	ptr = a->pos;
+	a->pos += size;
+	a->left -= size;
+
+	return ptr;
+}
+
+char *
+arena_strndup(struct arena *a, const char *str, size_t len)
+{
+	char *copy = arena_alloc(a, len + 1);
+
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	return copy;
+}
+
+void
+arena_free(struct arena *a)
+{
+	while (a->blocks != NULL) {
+		struct arena_block *next = a->blocks->next;
+
+		free(a->blocks);
+		a->blocks = next;
+	}
+	arena_init(a);
+}
@@ -0,0 +1,99 @@
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Error handling, buffered i/o and an arena, shared by the tools.
+ *
+ * die() prints its message and exits; a message ending in ':' gets the
+ * error of errno appended. The x functions die instead of returning
+ * failure.
+ */
+void die(const char *, ...);
+void *xmalloc(size_t);
+void *xcalloc(size_t, size_t);
+void *xrealloc(void *, size_t);
+FILE *xfopen(const char *, const char *);
+
+/*
+ * Readers map regular files of at least READER_BUFSIZE bytes and read
+ * anything else into a page aligned buffer, telling the kernel the
+ * file is read sequentially either way. The last READER_PUSHBACK bytes
+ * read can always be put back.
+ *
+ * Errors are kept in error, as an errno value, and end the input; check
+ * it once done instead of after every read.
+ */
+#define READER_BUFSIZE (256 * 1024)
+#define READER_PUSHBACK 256
+
+struct reader {
+	const char *name;
+	int fd;
+	unsigned char *buf;	/* mapped file or alloc */
+	unsigned char *alloc;
+	size_t size, pos, len;
+	size_t maplen;
+	unsigned long nread;
+	int eof;
+	int error;
+};
+
+int reader_open(struct reader *, const char *);
+void reader_init(struct reader *, int, const char *);
+size_t reader_fill(struct reader *, size_t);
+int reader_refill(struct reader *);
+int reader_close(struct reader *);
+
+#define READ_BYTE(r) \
+	((r)->pos < (r)->len ? (r)->buf[(r)->pos++] : reader_refill(r))
+#define UNREAD_BYTE(r) (--(r)->pos)
+
+/*
+ * Writers buffer output in a page aligned buffer. As with readers an
+ * error is kept and ends the output; writer_close() returns it.
+ */
+#define WRITER_BUFSIZE (256 * 1024)
+
+struct writer {
+	const char *name;
+	int fd;
+	unsigned char *buf;
+	size_t len;
+	unsigned long nwritten;
+	int error;
+};
+
+int writer_open(struct writer *, const char *);
+void writer_init(struct writer *, int, const char *);
+void writer_write(struct writer *, const void *, size_t);
+void writer_putc(struct writer *, int);
+int writer_flush(struct writer *);
+int writer_close(struct writer *);
+
+#define WRITE_BYTE(w, c) \
+	((w)->len < WRITER_BUFSIZE ? (void)((w)->buf[(w)->len++] = (c)) : \
+	    writer_putc((w), (c)))
+
+/*
+ * Allocations that are freed all at once, out of blocks of at least
+ * ARENA_BLOCKSIZE.
+ */
+#define ARENA_BLOCKSIZE (64 * 1024)
+
+struct arena_block;
+
+struct arena {
+	struct arena_block *blocks;
+	char *pos;
+	size_t left;
+};
+
+void arena_init(struct arena *);
+void *arena_alloc(struct arena *, size_t);
+char *arena_strndup(struct arena *, const char *, size_t);
+void arena_free(struct arena *);
+
+#endif
@@ -0,0 +1,211 @@
+#include <string.h>
+
+#include <netpbm/pam.h>
+#include <netpbm/pbm.h>
+
+#include "diffuse.h"
+
+typedef unsigned short ushort;
+typedef unsigned char uchar;
+
+/*
+ * With more than two gray levels, every possible pixel plus error
+ * value in [QMIN, QMIN + QRANGE) is mapped to its nearest level up
+ * front; values outside that range are clamped.
+ */
+#define QMIN (-1024)
+#define QRANGE 3072
+
+static struct {
+	uchar level[QRANGE];
+	short value[QRANGE];
+} quant;
+
+/*
+ * Set up the multilevel spans for levels gray levels. The table is
+ * shared, so a process dithers to one number of levels.
+ */
+void
+diffuse_levels(int levels)
+{
+	int n = levels - 1;
+	int i;
+
+	for (i = 0; i < QRANGE; ++i) {
+		int Y = QMIN + i;
+		int l;
+
+		l = (Y * n + 127) / 255;
+		if (l < 0)
+			l = 0;
+		if (l > n)
+			l = n;
+
+		quant.level[i] = l;
+		quant.value[i] = l * 255 / n;
+	}
+}
+
+/*
+ * Error diffusion kernels as lists of taps T(dx, dy, weight); each tap
+ * gets diff * weight / divisor of the error. The lists are expanded
+ * into a separate loop per kernel and direction below, so the taps are
+ * constants in the inner loop.
+ */
+#define ATKINSON(T) \
+	T( 1, 0, 1) T( 2, 0, 1) \
+	T(-1, 1, 1) T( 0, 1, 1) T( 1, 1, 1) \
+	T( 0, 2, 1)
+#define ATKINSON_DIV 8
+
+#define FLOYD(T) \
+	T( 1, 0, 7) \
+	T(-1, 1, 3) T( 0, 1, 5) T( 1, 1, 1)
+#define FLOYD_DIV 16
+
+#define JARVIS(T) \
+	T( 1, 0, 7) T( 2, 0, 5) \
+	T(-2, 1, 3) T(-1, 1, 5) T( 0, 1, 7) T( 1, 1, 5) T( 2, 1, 3) \
+	T(-2, 2, 1) T(-1, 2, 3) T( 0, 2, 5) T( 1, 2, 3) T( 2, 2, 1)
+#define JARVIS_DIV 48
+
+#define STUCKI(T) \
+	T( 1, 0, 8) T( 2, 0, 4) \
+	T(-2, 1, 2) T(-1, 1, 4) T( 0, 1, 8) T( 1, 1, 4) T( 2, 1, 2) \
+	T(-2, 2, 1) T(-1, 2, 2) T( 0, 2, 4) T( 1, 2, 2) T( 2, 2, 1)
+#define STUCKI_DIV 42
+
+#define SIERRA(T) \
+	T( 1, 0, 5) T( 2, 0, 3) \
+	T(-2, 1, 2) T(-1, 1, 4) T( 0, 1, 5) T( 1, 1, 4) T( 2, 1, 2) \
+	T(-1, 2, 2) T( 0, 2, 3) T( 1, 2, 2)
+#define SIERRA_DIV 32
+
+/* Distribute the error over one tap, mirrored when going right to left. */
+#define SPREAD(dx, dy, w) e##dy[idx + (dx) * dir] += diff * (w) / div;
+
+/* Pick the output value v and its intensity cv for Y. */
+#define BILEVEL(Y, cv, v)						\
+	cv = (Y > 127) ? 255 : 0;					\
+	v = (cv == 0) ? PBM_BLACK : PBM_WHITE;
+
+#define MULTILEVEL(Y, cv, v) {						\
+	int i = Y < QMIN ? 0 : Y >= QMIN + QRANGE ? QRANGE - 1 : Y - QMIN; \
+									\
+	cv = quant.value[i];						\
+	v = quant.level[i];						\
+}
+
+/*
+ * Dither pixels x0 up to x1 of a row, left to right when dir is 1 and
+ * right to left when it is -1. The error rows e0, e1 and e2 belong to
+ * this row and the two below it and have DIFFUSE_PAD pixels of padding.
+ */
+#define DITHER_SPAN(name, TAPS, divisor, direction, QUANTIZE)		\
+static void								\
+name(const ushort *gray, int *e0, int *e1, int *e2, bit *out,		\
+    int x0, int x1)							\
+{									\
+	enum { div = divisor, dir = direction };			\
+	int x, end;							\
+									\
+	(void)e2;	/* not every kernel reaches two rows down */	\
+									\
+	x = dir > 0 ? x0 : x1 - 1;					\
+	end = dir > 0 ? x1 : x0 - 1;					\
+									\
+	for (; x != end; x += dir) {					\
+		int Y, cv, v, diff, idx;				\
+									\
+		idx = x + DIFFUSE_PAD;					\
+									\
+		Y = gray[x] + e0[idx];					\
+									\
+		QUANTIZE(Y, cv, v)					\
+		diff = Y - cv;						\
+									\
+		TAPS(SPREAD)						\
+									\
+		out[x] = v;						\
+	}								\
+}
+
+/* Both directions, for black and white and for gray levels. */
+#define DITHER_KERNEL(name, TAPS, divisor)				\
+DITHER_SPAN(name##_fwd, TAPS, divisor, 1, BILEVEL)			\
+DITHER_SPAN(name##_rev, TAPS, divisor, -1, BILEVEL)			\
+DITHER_SPAN(name##_fwd_n, TAPS, divisor, 1, MULTILEVEL)		\
+DITHER_SPAN(name##_rev_n, TAPS, divisor, -1, MULTILEVEL)
+
+DITHER_KERNEL(atkinson, ATKINSON, ATKINSON_DIV)
+DITHER_KERNEL(floyd, FLOYD, FLOYD_DIV)
+DITHER_KERNEL(jarvis, JARVIS, JARVIS_DIV)
+DITHER_KERNEL(stucki, STUCKI, STUCKI_DIV)
+DITHER_KERNEL(sierra, SIERRA, SIERRA_DIV)
+
+#define TAP(dx, dy, w) { dx, dy, w },
+
+static const struct tap atkinson_taps[] = { ATKINSON(TAP) };
+static const struct tap floyd_taps[] = { FLOYD(TAP) };
+static const struct tap jarvis_taps[] = { JARVIS(TAP) };
+static const struct tap stucki_taps[] = { STUCKI(TAP) };
+static const struct tap sierra_taps[] = { SIERRA(TAP) };
+
+#define KERNEL(name) \
+	{ #name, name##_taps, sizeof(name##_taps) / sizeof(struct tap), \
+	  { { name##_fwd, name##_rev }, { name##_fwd_n, name##_rev_n } } }
+
+const struct kernel diffuse_kernels[] = {
+	KERNEL(atkinson),
+	KERNEL(floyd),
+	KERNEL(jarvis),
+	KERNEL(stucki),
+	KERNEL(sierra),
+};
+
+const int diffuse_nkernels =
+    (int)(sizeof(diffuse_kernels) / sizeof(diffuse_kernels[0]));
+
+/*
+ * Returns the kernel called name, or NULL when there is none.
+ */
+const struct kernel *
+diffuse_find(const char *name)
+{
+	int i;
+
+	for (i = 0; i < diffuse_nkernels; ++i)
+		if (strcmp(diffuse_kernels[i].name, name) == 0)
+			return &diffuse_kernels[i];
+
+	return NULL;
+}
+
+/*
+ * How many pixels the row above must have finished before a row may
+ * dither pixel x, minus x. The row above has to be far enough ahead
+ * that everything it still spreads into this row's error row, and
+ * into the row below, lands right of what this row touches at x.
+ */
+int
+diffuse_lag(const struct kernel *k)
+{
+	int mindx[3] = { 0, 0, 0 }, maxdx[3] = { 0, 0, 0 };
+	int i, lag;
+
+	for (i = 0; i < k->ntaps; ++i) {
+		const struct tap *t = &k->taps[i];
+
+		if (t->dx < mindx[t->dy])
+			mindx[t->dy] = t->dx;
+		if (t->dx > maxdx[t->dy])
+			maxdx[t->dy] = t->dx;
+	}
+
+	lag = maxdx[0] - mindx[1];
+	if (maxdx[1] - mindx[2] > lag)
+		lag = maxdx[1] - mindx[2];
+
+	return lag + 1;
+}
+
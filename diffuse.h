@@ -0,0 +1,35 @@
+#ifndef DIFFUSE_H
+#define DIFFUSE_H
+
+/*
+ * Error diffusion kernels. A span function dithers part of a row of
+ * 8-bit gray values into PBM bits, or gray levels after
+ * diffuse_levels(), spreading the error over the error rows of this
+ * row and the two below it.
+ */
+
+/* Error rows are padded on both sides for taps up to 2 pixels away. */
+#define DIFFUSE_PAD 2
+
+struct tap {
+	int dx, dy, w;
+};
+
+typedef void (*span_fn)(const unsigned short *, int *, int *, int *, bit *,
+    int, int);
+
+struct kernel {
+	const char *name;
+	const struct tap *taps;
+	int ntaps;
+	span_fn span[2][2];	/* [multilevel][right to left] */
+};
+
+extern const struct kernel diffuse_kernels[];
+extern const int diffuse_nkernels;
+
+const struct kernel *diffuse_find(const char *);
+int diffuse_lag(const struct kernel *);
+void diffuse_levels(int);
+
+#endif
@@ -0,0 +1,671 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <netpbm/pam.h>
+#include <netpbm/pbm.h>
+#include <netpbm/pgm.h>
+#include <netpbm/ppm.h>
+
+#include "colorspace.h"
+#include "diffuse.h"
+#include "ordered.h"
+#include "rawpnm.h"
+#include "stats.h"
+
+enum { R, G, B };
+typedef unsigned short ushort;
+typedef unsigned char uchar;
+
+/*
+ * Rows are passed between stages as packed 8-bit samples: PBM bits
+ * (1 is black), gray or red, green and blue. ANY is for stages that
+ * work on gray and color rows alike.
+ */
+enum format { BITS, GRAY, RGB, ANY };
+static const char *format_names[] = { "bilevel", "gray", "rgb" };
+
+/* Rows buffered between two stages when every stage has a thread. */
+#define QLEN 32
+
+enum hues { WHITE, AMBER, CYAN, GREEN };
+static const char *hue_names[] = { "white", "amber", "cyan", "green" };
+
+struct stage;
+typedef void (*stage_fn)(struct stage *, uchar *, const uchar *, int);
+
+struct stage {
+	const char *name;
+	enum format in, out;
+	int maxval;
+	stage_fn run;
+	int width;
+
+	/* gray and tint */
+	ushort weight[3][256];
+	uchar tint[256][3];
+	int mono;
+
+	/* quantize */
+	uchar value[256];
+
+	/* diffuse */
+	const struct kernel *kernel;
+	int levels;
+	ushort *gray;
+	int *err;
+	int cols;
+};
+
+/*
+ * The row handoff between two stages, a ring of QLEN rows. head is the
+ * number of rows put in, tail the number taken out.
+ */
+struct queue {
+	uchar *buf[QLEN];
+	int head, tail;
+};
+
+struct pipeline {
+	struct stage *stages;
+	int nstages;
+	int width, height;
+	struct queue *queues;
+};
+
+struct worker {
+	struct pipeline *pl;
+	int id;
+};
+
+/* Go through libnetpbm even for raw images, for comparison. */
+static int use_netpbm;
+
+static void *
+xmalloc(size_t size)
+{
+	void *ptr;
+
+	ptr = malloc(size);
+	if (ptr == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	return ptr;
+}
+
+static int
+lookup_name(const char **names, int n, const char *name)
+{
+	int i;
+
+	for (i = 0; i < n; ++i)
+		if (strcmp(names[i], name) == 0)
+			return i;
+
+	return -1;
+}
+
+/*
+ * Luminance with atkinson's weights, or makemono's with gray=mono. Both
+ * are sums of separately rounded terms, so they are exact as tables.
+ */
+static void
+run_gray(struct stage *st, uchar *dst, const uchar *src, int y)
+{
+	int x;
+
+	(void)y;
+
+	for (x = 0; x < st->width; ++x) {
+		dst[x] = st->weight[R][src[R]] + st->weight[G][src[G]] +
+		    st->weight[B][src[B]];
+		src += 3;
+	}
+}
+
+static void
+run_copy(struct stage *st, uchar *dst, const uchar *src, int y)
+{
+	(void)y;
+
+	memcpy(dst, src, st->width);
+}
+
+static void
+run_tint(struct stage *st, uchar *dst, const uchar *src, int y)
+{
+	int x;
+
+	(void)y;
+
+	for (x = 0; x < st->width; ++x) {
+		memcpy(dst, st->tint[src[x]], 3);
+		dst += 3;
+	}
+}
+
+static void
+run_quantize(struct stage *st, uchar *dst, const uchar *src, int y)
+{
+	int n = st->width * (st->in == RGB ? 3 : 1);
+	int i;
+
+	(void)y;
+
+	for (i = 0; i < n; ++i)
+		dst[i] = st->value[src[i]];
+}
+
+static void
+run_diffuse(struct stage *st, uchar *dst, const uchar *src, int y)
+{
+	int *e0 = &st->err[(y + 0) % 3 * st->cols];
+	int *e1 = &st->err[(y + 1) % 3 * st->cols];
+	int *e2 = &st->err[(y + 2) % 3 * st->cols];
+	int x;
+
+	for (x = 0; x < st->width; ++x)
+		st->gray[x] = src[x];
+
+	memset(e2, 0, st->cols * sizeof(*e2));
+	st->kernel->span[st->levels > 2][0](st->gray, e0, e1, e2, dst, 0,
+	    st->width);
+}
+
+static void
+run_bayer(struct stage *st, uchar *dst, const uchar *src, int y)
+{
+	(void)st;
+
+	ordered_row(dst, src, y);
+}
+
+/*
+ * Set up a stage from its name=arg argument.
+ */
+static void
+parse_stage(struct stage *st, char *spec, int nstage)
+{
+	static int diffuse_levels_set, bayer_set;
+	char *arg;
+	int i;
+
+	memset(st, 0, sizeof(*st));
+	arg = strchr(spec, '=');
+	if (arg != NULL)
+		*arg++ = '\0';
+	st->name = spec;
+	st->maxval = 255;
+
+	if (strcmp(spec, "gray") == 0) {
+		st->in = ANY;
+		st->out = GRAY;
+		st->run = run_gray;
+		st->mono = arg != NULL && strcmp(arg, "mono") == 0;
+		if (arg != NULL && !st->mono && strcmp(arg, "luma") != 0)
+			goto badarg;
+		for (i = 0; i < 256; ++i) {
+			if (st->mono) {
+				st->weight[R][i] = (i * 299L + 500) / 1000;
+				st->weight[G][i] = (i * 587L + 500) / 1000;
+				st->weight[B][i] = (i * 114L + 500) / 1000;
+			} else {
+				st->weight[R][i] = i * 21 / 100;
+				st->weight[G][i] = i * 72 / 100;
+				st->weight[B][i] = i * 7 / 100;
+			}
+		}
+	} else if (strcmp(spec, "tint") == 0) {
+		int hue = arg == NULL ? WHITE : lookup_name(hue_names, 4, arg);
+
+		if (hue < 0)
+			goto badarg;
+		st->in = GRAY;
+		st->out = RGB;
+		st->run = run_tint;
+		for (i = 0; i < 256; ++i) {
+			st->tint[i][R] = hue == CYAN || hue == GREEN ? 0 : i;
+			st->tint[i][G] = hue == AMBER ? i * 191L / 255 : i;
+			st->tint[i][B] = hue == WHITE || hue == CYAN ? i : 0;
+		}
+	} else if (strcmp(spec, "quantize") == 0) {
+		int n;
+
+		st->levels = arg == NULL ? 0 : atoi(arg);
+		if (st->levels < 2 || st->levels > 256)
+			goto badarg;
+		st->in = ANY;
+		st->out = ANY;
+		st->run = run_quantize;
+		n = st->levels - 1;
+		for (i = 0; i < 256; ++i)
+			st->value[i] = (i * n + 127) / 255 * 255 / n;
+	} else if (strcmp(spec, "diffuse") == 0) {
+		char *levels = arg == NULL ? NULL : strchr(arg, ':');
+
+		if (levels != NULL)
+			*levels++ = '\0';
+		st->kernel = diffuse_find(arg == NULL ? "atkinson" : arg);
+		st->levels = levels == NULL ? 2 : atoi(levels);
+		if (st->kernel == NULL || st->levels < 2 || st->levels > 256)
+			goto badarg;
+
+		/* The multilevel table is shared by all diffuse stages. */
+		if (st->levels > 2) {
+			if (diffuse_levels_set && diffuse_levels_set !=
+			    st->levels) {
+				fprintf(stderr, "diffuse stages should all "
+				    "use the same number of levels.\n");
+				exit(1);
+			}
+			diffuse_levels(st->levels);
+			diffuse_levels_set = st->levels;
+		}
+		st->in = GRAY;
+		st->out = st->levels > 2 ? GRAY : BITS;
+		st->maxval = st->levels - 1;
+		st->run = run_diffuse;
+	} else if (strcmp(spec, "bayer") == 0) {
+		if (bayer_set++) {
+			fprintf(stderr, "only one bayer stage is supported.\n");
+			exit(1);
+		}
+		ordered_palette(arg == NULL ? ORDERED_DEFAULT_PALETTE : arg);
+		ordered_metric("rgb");
+		ordered_init(0);
+		st->in = RGB;
+		st->out = RGB;
+		st->run = run_bayer;
+	} else {
+		fprintf(stderr, "stage %d: unknown stage %s.\n", nstage, spec);
+		exit(1);
+	}
+
+	return;
+
+badarg:
+	fprintf(stderr, "stage %d: bad argument %s for %s.\n", nstage,
+	    arg == NULL ? "(none)" : arg, spec);
+	exit(1);
+}
+
+/*
+ * Check that every stage gets rows it can work on and give each the
+ * buffers it needs. Returns the format of the output.
+ */
+static enum format
+connect_stages(struct stage *stages, int nstages, enum format fmt,
+    int width, int *maxval)
+{
+	int i;
+
+	*maxval = 255;
+	for (i = 0; i < nstages; ++i) {
+		struct stage *st = &stages[i];
+
+		if (st->in == ANY && fmt != BITS)
+			st->in = fmt;
+		if (st->in != fmt) {
+			fprintf(stderr, "%s: needs %s input, got %s.\n",
+			    st->name, st->in == ANY ? "gray or rgb" :
+			    format_names[st->in], format_names[fmt]);
+			exit(1);
+		}
+		if (*maxval != 255) {
+			fprintf(stderr, "%s: needs 8-bit input, got %d "
+			    "levels.\n", st->name, *maxval + 1);
+			exit(1);
+		}
+
+		if (st->run == run_gray && st->in == GRAY)
+			st->run = run_copy;
+		if (st->out == ANY)
+			st->out = st->in;
+		st->width = width;
+
+		if (st->run == run_diffuse) {
+			st->gray = xmalloc(width * sizeof(*st->gray) + 1);
+			st->cols = width + 2 * DIFFUSE_PAD;
+			st->err = calloc(3 * st->cols, sizeof(*st->err));
+			if (st->err == NULL) {
+				perror("calloc");
+				exit(1);
+			}
+		} else if (st->run == run_bayer)
+			ordered_rows(width, 3);
+
+		fmt = st->out;
+		*maxval = st->maxval;
+	}
+
+	return fmt;
+}
+
+/*
+ * Input rows are 8-bit gray or color. Alpha is dropped and samples
+ * are scaled to 255 when the image has another maxval.
+ */
+struct source {
+	struct pam *pam;
+	struct rawpnm raw;
+	int israw;
+	tuple *row;
+};
+
+static void
+source_open(struct source *src, struct pam *pam)
+{
+	src->pam = pam;
+	src->israw = !use_netpbm && pam->maxval == 255 &&
+	    rawpnm_open(&src->raw, pam);
+	src->row = src->israw ? NULL : pnm_allocpamrow(pam);
+}
+
+static void
+source_close(struct source *src)
+{
+	if (src->israw)
+		rawpnm_close(&src->raw);
+	else
+		pnm_freepamrow(src->row);
+}
+
+static void
+source_row(struct source *src, uchar *dst)
+{
+	int depth = src->pam->depth;
+	int n = depth >= 3 ? 3 : 1;
+	int width = src->pam->width;
+	int x, c;
+
+	if (src->israw) {
+		const uchar *p = rawpnm_readrow(&src->raw);
+
+		if (depth == n) {
+			memcpy(dst, p, (size_t)width * n);
+			return;
+		}
+		for (x = 0; x < width; ++x) {
+			for (c = 0; c < n; ++c)
+				*dst++ = p[c];
+			p += depth;
+		}
+	} else {
+		sample maxval = src->pam->maxval;
+
+		pnm_readpamrow(src->pam, src->row);
+		for (x = 0; x < width; ++x)
+			for (c = 0; c < n; ++c)
+				*dst++ = (src->row[x][c] * 255 + maxval / 2) /
+				    maxval;
+	}
+}
+
+static void
+write_init(enum format fmt, int width, int height, int maxval)
+{
+	switch (fmt) {
+	case BITS:
+		pbm_writepbminit(stdout, width, height, 0);
+		break;
+	case GRAY:
+		pgm_writepgminit(stdout, width, height, maxval, 0);
+		break;
+	default:
+		ppm_writeppminit(stdout, width, height, maxval, 0);
+		break;
+	}
+}
+
+static void
+write_row(enum format fmt, const uchar *row, int width, uchar *outbuf)
+{
+	size_t n = (size_t)width * (fmt == RGB ? 3 : 1);
+
+	if (fmt == BITS)
+		rawpbm_writerow(stdout, row, width, outbuf);
+	else
+		rawpnm_writerow(stdout, row, n);
+}
+
+static void
+run_serial(struct pipeline *pl, struct source *src, enum format fmt)
+{
+	uchar *buf[2], *outbuf;
+	int i, y;
+
+	buf[0] = xmalloc(3 * pl->width + 1);
+	buf[1] = xmalloc(3 * pl->width + 1);
+	outbuf = xmalloc(pl->width + 1);
+
+	for (y = 0; y < pl->height; ++y) {
+		source_row(src, buf[0]);
+		for (i = 0; i < pl->nstages; ++i)
+			pl->stages[i].run(&pl->stages[i], buf[(i + 1) & 1],
+			    buf[i & 1], y);
+		write_row(fmt, buf[pl->nstages & 1], pl->width, outbuf);
+	}
+
+	free(outbuf);
+	free(buf[1]);
+	free(buf[0]);
+}
+
+static int
+load(int *p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void
+store(int *p, int v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void
+wait_for(int *p, int v)
+{
+	while (load(p) < v)
+		sched_yield();
+}
+
+/*
+ * Stage i takes rows from queue i and puts them in queue i + 1, the
+ * main thread fills queue 0 and the writer empties the last one.
+ */
+static void *
+stage_worker(void *arg)
+{
+	struct worker *w = arg;
+	struct pipeline *pl = w->pl;
+	struct stage *st = &pl->stages[w->id];
+	struct queue *in = &pl->queues[w->id];
+	struct queue *out = &pl->queues[w->id + 1];
+	int y;
+
+	for (y = 0; y < pl->height; ++y) {
+		wait_for(&in->head, y + 1);
+		wait_for(&out->tail, y + 1 - QLEN);
+		st->run(st, out->buf[y % QLEN], in->buf[y % QLEN], y);
+		store(&out->head, y + 1);
+		store(&in->tail, y + 1);
+	}
+
+	return NULL;
+}
+
+struct writer {
+	struct pipeline *pl;
+	enum format fmt;
+};
+
+static void *
+row_writer(void *arg)
+{
+	struct writer *w = arg;
+	struct pipeline *pl = w->pl;
+	struct queue *in = &pl->queues[pl->nstages];
+	uchar *outbuf;
+	int y;
+
+	outbuf = xmalloc(pl->width + 1);
+	for (y = 0; y < pl->height; ++y) {
+		wait_for(&in->head, y + 1);
+		write_row(w->fmt, in->buf[y % QLEN], pl->width, outbuf);
+		store(&in->tail, y + 1);
+	}
+	free(outbuf);
+
+	return NULL;
+}
+
+static void
+run_threaded(struct pipeline *pl, struct source *src, enum format fmt)
+{
+	struct worker *workers;
+	struct writer wr;
+	pthread_t *threads, writer;
+	int i, y;
+
+	pl->queues = calloc(pl->nstages + 1, sizeof(*pl->queues));
+	if (pl->queues == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i <= pl->nstages; ++i)
+		for (y = 0; y < QLEN; ++y)
+			pl->queues[i].buf[y] = xmalloc(3 * pl->width + 1);
+
+	workers = xmalloc(pl->nstages * sizeof(*workers));
+	threads = xmalloc(pl->nstages * sizeof(*threads));
+	for (i = 0; i < pl->nstages; ++i) {
+		workers[i].pl = pl;
+		workers[i].id = i;
+		if (pthread_create(&threads[i], NULL, stage_worker,
+		    &workers[i]) != 0) {
+			fprintf(stderr, "pthread_create failed.\n");
+			exit(1);
+		}
+	}
+	wr.pl = pl;
+	wr.fmt = fmt;
+	if (pthread_create(&writer, NULL, row_writer, &wr) != 0) {
+		fprintf(stderr, "pthread_create failed.\n");
+		exit(1);
+	}
+
+	for (y = 0; y < pl->height; ++y) {
+		wait_for(&pl->queues[0].tail, y + 1 - QLEN);
+		source_row(src, pl->queues[0].buf[y % QLEN]);
+		store(&pl->queues[0].head, y + 1);
+	}
+
+	for (i = 0; i < pl->nstages; ++i)
+		pthread_join(threads[i], NULL);
+	pthread_join(writer, NULL);
+
+	for (i = 0; i <= pl->nstages; ++i)
+		for (y = 0; y < QLEN; ++y)
+			free(pl->queues[i].buf[y]);
+	free(pl->queues);
+	free(threads);
+	free(workers);
+}
+
+static void
+usage(void)
+{
+	int i;
+
+	fprintf(stderr,
+	    "usage: imgpipe [-nt] stage ... < in.pnm > out.pnm\n\n"
+	    "stages:\n"
+	    "  gray[=luma|mono]           color to gray, atkinson's or "
+	    "makemono's weights\n"
+	    "  tint=white|amber|cyan|green\n"
+	    "                             gray to color like makemono\n"
+	    "  quantize=levels            round samples to levels\n"
+	    "  diffuse[=kernel[:levels]]  error diffusion, to bilevel "
+	    "by default\n"
+	    "  bayer[=palette]            ordered dithering to a palette\n\n"
+	    "kernels:");
+	for (i = 0; i < diffuse_nkernels; ++i)
+		fprintf(stderr, " %s", diffuse_kernels[i].name);
+	fprintf(stderr, "\n");
+	ordered_list_palettes(stderr);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct pipeline pl;
+	struct source src;
+	struct pam inpam;
+	enum format fmt;
+	int threaded = 0;
+	unsigned long clock;
+	int ch, i, maxval;
+
+	pm_init(argv[0], 0);
+
+	while ((ch = getopt(argc, argv, "nt")) != -1) {
+		switch (ch) {
+		case 'n':
+			use_netpbm = 1;
+			break;
+		case 't':
+			threaded = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc == 0)
+		usage();
+
+	stats_init("imgpipe", 0);
+	clock = stats_clock();
+
+	pl.nstages = argc;
+	pl.stages = xmalloc(argc * sizeof(*pl.stages));
+	for (i = 0; i < argc; ++i)
+		parse_stage(&pl.stages[i], argv[i], i + 1);
+
+	pnm_readpaminit(stdin, &inpam, PAM_STRUCT_SIZE(tuple_type));
+	pl.width = inpam.width;
+	pl.height = inpam.height;
+
+	fmt = connect_stages(pl.stages, pl.nstages,
+	    inpam.depth >= 3 ? RGB : GRAY, pl.width, &maxval);
+	write_init(fmt, pl.width, pl.height, maxval);
+	stats_lap("init", &clock);
+
+	source_open(&src, &inpam);
+	if (threaded)
+		run_threaded(&pl, &src, fmt);
+	else
+		run_serial(&pl, &src, fmt);
+	source_close(&src);
+	stats_lap("run", &clock);
+	stats_count("pixels", (unsigned long)pl.width * pl.height);
+	stats_count("stages", pl.nstages);
+
+	for (i = 0; i < pl.nstages; ++i) {
+		free(pl.stages[i].gray);
+		free(pl.stages[i].err);
+	}
+	free(pl.stages);
+
+	return 0;
+}
@@ -1,73 +1,178 @@
+#include <sys/stat.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "stats.h"
 
-#define MAXLINELEN 8192
+/*
+ * Input is converted as it is buffered by the reader, all at once for
+ * a mapped file. A possible color the parser could not finish before
+ * the end of what is buffered is kept for the next read, so colors are
+ * found wherever the reads happen to split them.
+ */
+#define MAXALPHALEN 16
 
 enum hues {
 	WHITE, AMBER, CYAN, GREEN
 };
 
 enum color_types {
-	HEXCOLOR, RGBCOLOR
+	HEXCOLOR, HEXACOLOR, RGBCOLOR, RGBACOLOR, X11COLOR
 };
 
+/*
+ * Alpha is passed through: a byte for #rrggbbaa, the text as written
+ * for rgba(). X11 colors remember how many hex digits they had.
+ */
 struct color {
 	enum color_types type;
-	unsigned char r, g, b;
+	unsigned char r, g, b, a;
+	const char *alpha;
+	size_t alphalen;
+	int digits;
 };
 
-static void *
-xmalloc(size_t size)
+/*
+ * Gray is the sum of the rounded weighted channels, looked up per
+ * channel, and then mapped to the hue.
+ */
+static unsigned char red_gray[256], green_gray[256], blue_gray[256];
+static unsigned char hue_red[256], hue_green[256], hue_blue[256];
+
+/* Characters a color can start with. */
+static unsigned char starts_color[256];
+
+/*
+ * The parsers return a pointer past the color, NULL if there is none,
+ * or more if the input ended before they could tell. The helpers pass
+ * NULL and more on, so they are only checked at the end.
+ */
+static const char more[1];
+
+/* What was converted, for the stats. */
+struct counts {
+	unsigned long files, failed, colors, nread, nwritten;
+};
+
+/*
+ * One conversion. Everything is written through out, there is no stdio
+ * formatting per color. A read or write error ends the conversion.
+ */
+struct mono {
+	struct reader in;
+	struct writer out;
+	struct counts counts;
+};
+
+/*
+ * Batch mode converts each of a list of files to dst, through a
+ * temporary file next to it that is renamed over it when done.
+ */
+struct job {
+	char *src;
+	char *dst;
+};
+
+struct batch {
+	struct job *jobs;
+	int njobs, maxjobs;
+	int next;
+	int failed;
+	struct counts counts;
+	dev_t outdev;		/* the outdir, which is not walked */
+	ino_t outino;
+};
+
+static char *
+join_path(const char *dir, const char *name)
 {
-	void *ptr;
+	char *path;
 
-	ptr = malloc(size);
-	if (ptr == NULL) {
-		fprintf(stderr, "Out of memory!\n");
-		exit(EXIT_FAILURE);
-	}
+	path = xmalloc(strlen(dir) + strlen(name) + 2);
+	sprintf(path, "%s/%s", dir, name);
 
-	return ptr;
+	return path;
 }
 
-struct color *
-parse_hexcolor(const char *str, size_t *len)
+static void
+put_bytes(struct mono *m, const char *str, size_t len)
 {
-	struct color *color = NULL;
-	unsigned int r, g, b;
+	writer_write(&m->out, str, len);
+}
 
-	if (*str != '#' || len == NULL)
-		return NULL;
+static int
+hexdigit(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
 
-	color = xmalloc(sizeof(*color));
-	*len = 0;
+/*
+ * A color has to end where a word ends, so #add-button or #fade_in
+ * are left alone.
+ */
+static int
+is_word(int c)
+{
+	return isalnum((unsigned char)c) || c == '_' || c == '-';
+}
 
-	if (sscanf(str, "#%02x%02x%02x", &r, &g, &b) == 3) {
-		if (!(isspace(str[7]) || str[7] == '\0'))
-			goto err;
+/*
+ * Parse #rgb, #rgba, #rrggbb or #rrggbbaa at str.
+ */
+static const char *
+parse_hexcolor(const char *str, const char *end, struct color *color)
+{
+	int d[8];
+	int n = 0;
+	const char *p = str + 1;
+
+	while (p < end && n < 8 && (d[n] = hexdigit(*p)) >= 0) {
+		++n;
+		++p;
+	}
 
-		color->r = r;
-		color->g = g;
-		color->b = b;
-		*len = 7;
-	} else if (sscanf(str, "#%1x%1x%1x", &r, &g, &b) == 3) {
-		if (!(isspace(str[4]) || str[4] == '\0'))
-			goto err;
+	if (p < end && is_word(*p))
+		return NULL;
 
-		color->r = 16 * r + r;
-		color->g = 16 * g + g;
-		color->b = 16 * b + b;
-		*len = 4;
+	switch (n) {
+	case 3:
+	case 4:
+		color->r = d[0] * 17;
+		color->g = d[1] * 17;
+		color->b = d[2] * 17;
+		break;
+	case 6:
+	case 8:
+		color->r = d[0] * 16 + d[1];
+		color->g = d[2] * 16 + d[3];
+		color->b = d[4] * 16 + d[5];
+		break;
+	default:
+		return p == end ? more : NULL;
 	}
 
-	color->type = HEXCOLOR;
-	return color;
+	if (n == 4 || n == 8) {
+		color->type = HEXACOLOR;
+		color->a = n == 4 ? d[3] * 17 : d[6] * 16 + d[7];
+	} else
+		color->type = HEXCOLOR;
 
-err:
-	free(color);
-	return NULL;
+	return p;
 }
 
 static int
@@ -83,121 +188,698 @@ is_valid_rgb(int r, int g, int b)
 	return 1;
 }
 
-static struct color *
-parse_rgbcolor(const char *str, size_t *len)
+/*
+ * Match name at p, which may be cut off by the end of the input.
+ */
+static const char *
+match(const char *p, const char *end, const char *name)
+{
+	size_t len = strlen(name);
+
+	if (p == NULL || p == more)
+		return p;
+	if ((size_t)(end - p) < len)
+		return memcmp(p, name, end - p) == 0 ? more : NULL;
+
+	return memcmp(p, name, len) == 0 ? p + len : NULL;
+}
+
+static const char *
+skip_space(const char *p, const char *end)
+{
+	if (p == NULL || p == more)
+		return p;
+
+	while (p < end && isspace((unsigned char)*p))
+		++p;
+
+	return p < end ? p : more;
+}
+
+static const char *
+expect(const char *p, const char *end, int c)
+{
+	p = skip_space(p, end);
+	if (p == NULL || p == more)
+		return p;
+
+	return *p == c ? p + 1 : NULL;
+}
+
+/*
+ * Parse a decimal number after optional whitespace. Returns a pointer
+ * past it.
+ */
+static const char *
+parse_number(const char *p, const char *end, int *n)
+{
+	const char *digits;
+
+	p = skip_space(p, end);
+	if (p == NULL || p == more)
+		return p;
+
+	for (digits = p, *n = 0; p < end && *p >= '0' && *p <= '9'; ++p)
+		if (*n < 1000)
+			*n = *n * 10 + *p - '0';
+
+	if (p == end)
+		return more;
+	return p == digits ? NULL : p;
+}
+
+/*
+ * Like parse_number, with an optional fraction.
+ */
+static const char *
+parse_real(const char *p, const char *end, double *x)
+{
+	const char *digits;
+	double scale = 1;
+
+	p = skip_space(p, end);
+	if (p == NULL || p == more)
+		return p;
+
+	for (digits = p, *x = 0; p < end && *p >= '0' && *p <= '9'; ++p)
+		if (*x < 1000)
+			*x = *x * 10 + *p - '0';
+	if (p < end && *p == '.')
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p)
+			*x += (*p - '0') * (scale /= 10);
+
+	if (p == end)
+		return more;
+	return p == digits || (p == digits + 1 && *digits == '.') ? NULL : p;
+}
+
+/*
+ * The alpha of rgba() or hsla() is kept as written, a number or a
+ * percentage of at most MAXALPHALEN characters.
+ */
+static const char *
+parse_alpha(const char *p, const char *end, struct color *color)
+{
+	double x;
+	const char *q;
+
+	p = skip_space(expect(p, end, ','), end);
+	q = parse_real(p, end, &x);
+	if (q == NULL || q == more)
+		return q;
+	if (*q == '%')
+		++q;
+	if (q - p > MAXALPHALEN)
+		return NULL;
+
+	color->alpha = p;
+	color->alphalen = q - p;
+
+	return expect(q, end, ')');
+}
+
+/*
+ * Parse the hex digits of one X11 rgb: component, scaled to 8 bits.
+ */
+static const char *
+parse_x11(const char *p, const char *end, int *v, int *digits)
 {
-	struct color *color = NULL;
+	long n = 0, max = 0;
+	int d;
+
+	if (p == NULL || p == more)
+		return p;
+
+	for (*digits = 0; p < end && *digits < 4 &&
+	    (d = hexdigit(*p)) >= 0; ++p, ++*digits) {
+		n = n * 16 + d;
+		max = max * 16 + 15;
+	}
+
+	if (*digits == 0)
+		return p == end ? more : NULL;
+
+	*v = (n * 255 + max / 2) / max;
+	return p;
+}
+
+/*
+ * Parse rgb(r, g, b), rgba(r, g, b, a) or rgb:r/g/b with one to four
+ * hex digits per component at str.
+ */
+static const char *
+parse_rgbcolor(const char *str, const char *end, struct color *color)
+{
+	const char *p;
 	int r, g, b;
 
-	if (*str != 'r')
+	if ((p = match(str, end, "rgb:")) != NULL) {
+		int rd, gd, bd;
+
+		p = parse_x11(p, end, &r, &rd);
+		p = parse_x11(match(p, end, "/"), end, &g, &gd);
+		p = parse_x11(match(p, end, "/"), end, &b, &bd);
+		if (p == NULL || p == more)
+			return p;
+		if (p < end && is_word(*p))
+			return NULL;
+
+		color->type = X11COLOR;
+		color->digits = rd == gd && gd == bd ? rd : 2;
+	} else if ((p = match(str, end, "rgb(")) != NULL) {
+		p = parse_number(p, end, &r);
+		p = parse_number(expect(p, end, ','), end, &g);
+		p = parse_number(expect(p, end, ','), end, &b);
+		p = expect(p, end, ')');
+		color->type = RGBCOLOR;
+	} else if ((p = match(str, end, "rgba(")) != NULL) {
+		p = parse_number(p, end, &r);
+		p = parse_number(expect(p, end, ','), end, &g);
+		p = parse_number(expect(p, end, ','), end, &b);
+		p = parse_alpha(p, end, color);
+		color->type = RGBACOLOR;
+	}
+
+	if (p == NULL || p == more)
+		return p;
+	if (!is_valid_rgb(r, g, b))
 		return NULL;
 
-	if (sscanf(str, "rgb(%d, %d, %d)", &r, &g, &b) == 3 &&
-	    is_valid_rgb(r, g, b)) {
-		const char *p;
+	color->r = r;
+	color->g = g;
+	color->b = b;
 
-		color = xmalloc(sizeof(*color));
+	return p;
+}
+
+/*
+ * Parse hsl(h, s%, l%) or hsla(h, s%, l%, a) at str and convert it to
+ * rgb() or rgba().
+ */
+static const char *
+parse_hslcolor(const char *str, const char *end, struct color *color)
+{
+	/* Which of r, g and b get c and x in each sixth of the hue. */
+	static const int order[6][2] = {
+		{ 0, 1 }, { 1, 0 }, { 1, 2 }, { 2, 1 }, { 2, 0 }, { 0, 2 }
+	};
+	const char *p, *deg;
+	double h, s, l, c, x, m, rgb[3];
+	int sector;
+
+	if ((p = match(str, end, "hsl(")) == NULL)
+		p = match(str, end, "hsla(");
+
+	p = parse_real(p, end, &h);
+	if ((deg = match(p, end, "deg")) != NULL)
+		p = deg;
+	p = parse_real(expect(p, end, ','), end, &s);
+	p = expect(p, end, '%');
+	p = parse_real(expect(p, end, ','), end, &l);
+	p = expect(p, end, '%');
+
+	if (p != NULL && p != more && str[3] == 'a') {
+		p = parse_alpha(p, end, color);
+		color->type = RGBACOLOR;
+	} else {
+		p = expect(p, end, ')');
 		color->type = RGBCOLOR;
-		color->r = r;
-		color->g = g;
-		color->b = b;
+	}
 
-		p = str + sizeof("rgb(X,X,X") - 1;
-		while (*p++ != ')')
-			continue;
-		*len = p - str;
+	if (p == NULL || p == more)
+		return p;
+
+	if (s > 100 || l > 100) {
+		fprintf(stderr, "WARNING: invalid color %.*s found.\n",
+		    (int)(p - str), str);
+		return NULL;
 	}
 
-	return color;
+	while (h >= 360)
+		h -= 360;
+	s /= 100;
+	l /= 100;
+
+	c = (l < 0.5 ? 2 * l : 2 - 2 * l) * s;
+	sector = (int)(h / 60);
+	x = h / 60 - (sector & ~1);
+	x = c * (x < 1 ? x : 2 - x);
+	m = l - c / 2;
+
+	rgb[0] = rgb[1] = rgb[2] = m;
+	rgb[order[sector][0]] += c;
+	rgb[order[sector][1]] += x;
+
+	color->r = (int)(rgb[0] * 255 + 0.5);
+	color->g = (int)(rgb[1] * 255 + 0.5);
+	color->b = (int)(rgb[2] * 255 + 0.5);
+
+	return p;
+}
+
+static char *
+put_decimal(char *p, int n)
+{
+	if (n >= 100)
+		*p++ = '0' + n / 100;
+	if (n >= 10)
+		*p++ = '0' + n / 10 % 10;
+	*p++ = '0' + n % 10;
+
+	return p;
+}
+
+static const char hex[] = "0123456789abcdef";
+
+static char *
+put_hex(char *p, int n)
+{
+	*p++ = hex[n >> 4];
+	*p++ = hex[n & 15];
+
+	return p;
+}
+
+/*
+ * Write an 8-bit value as an X11 component of the given number of hex
+ * digits.
+ */
+static char *
+put_x11(char *p, int n, int digits)
+{
+	long max = (1L << 4 * digits) - 1;
+	long v = (n * max + 127) / 255;
+
+	while (digits-- > 0)
+		*p++ = hex[v >> 4 * digits & 15];
+
+	return p;
 }
 
 static void
-print_color(const struct color *color, FILE *fp)
+print_color(struct mono *m, const struct color *color)
 {
-	char *fmt;
+	char buf[sizeof("rgba(255, 255, 255, )") + MAXALPHALEN];
+	char *p = buf;
 
 	switch (color->type) {
 	case HEXCOLOR:
-		fmt = "#%02x%02x%02x";
+	case HEXACOLOR:
+		*p++ = '#';
+		p = put_hex(p, color->r);
+		p = put_hex(p, color->g);
+		p = put_hex(p, color->b);
+		if (color->type == HEXACOLOR)
+			p = put_hex(p, color->a);
 		break;
 	case RGBCOLOR:
-		fmt = "rgb(%d, %d, %d)";
+	case RGBACOLOR:
+		if (color->type == RGBACOLOR) {
+			memcpy(p, "rgba(", 5);
+			p += 5;
+		} else {
+			memcpy(p, "rgb(", 4);
+			p += 4;
+		}
+		p = put_decimal(p, color->r);
+		*p++ = ',';
+		*p++ = ' ';
+		p = put_decimal(p, color->g);
+		*p++ = ',';
+		*p++ = ' ';
+		p = put_decimal(p, color->b);
+		if (color->type == RGBACOLOR) {
+			*p++ = ',';
+			*p++ = ' ';
+			memcpy(p, color->alpha, color->alphalen);
+			p += color->alphalen;
+		}
+		*p++ = ')';
+		break;
+	case X11COLOR:
+		memcpy(p, "rgb:", 4);
+		p = put_x11(p + 4, color->r, color->digits);
+		*p++ = '/';
+		p = put_x11(p, color->g, color->digits);
+		*p++ = '/';
+		p = put_x11(p, color->b, color->digits);
 		break;
 	default:
 		fprintf(stderr, "illegal colortype %d\n", color->type);
 		exit(1);
 	}
 
-	fprintf(fp, fmt, color->r, color->g, color->b);
+	put_bytes(m, buf, p - buf);
 }
 
 static void
-color_to_mono(struct color *color, enum hues hue)
+init_tables(enum hues hue)
 {
-	int gray;
+	int i;
 
-	gray = (int)((color->r * 299L + 500) / 1000
-	    + (color->g * 587L + 500) / 1000
-	    + (color->b * 114L + 500) / 1000);
+	starts_color['#'] = starts_color['r'] = starts_color['h'] = 1;
 
-	switch (hue) {
-	default:
-	case WHITE:
-		color->r = gray;
-		color->g = gray;
-		color->b = gray;
-		break;
-	case AMBER:
-		color->r = gray;
-		color->g = (unsigned char)(gray * 191L / 255);
-		color->b = 0;
-		break;
-	case CYAN:
-		color->r = 0;
-		color->g = gray;
-		color->b = gray;
-		break;
-	case GREEN:
-		color->r = 0;
-		color->g = gray;
-		color->b = 0;
-		break;
+	for (i = 0; i < 256; ++i) {
+		red_gray[i] = (i * 299L + 500) / 1000;
+		green_gray[i] = (i * 587L + 500) / 1000;
+		blue_gray[i] = (i * 114L + 500) / 1000;
+
+		switch (hue) {
+		default:
+		case WHITE:
+			hue_red[i] = i;
+			hue_green[i] = i;
+			hue_blue[i] = i;
+			break;
+		case AMBER:
+			hue_red[i] = i;
+			hue_green[i] = (unsigned char)(i * 191L / 255);
+			hue_blue[i] = 0;
+			break;
+		case CYAN:
+			hue_red[i] = 0;
+			hue_green[i] = i;
+			hue_blue[i] = i;
+			break;
+		case GREEN:
+			hue_red[i] = 0;
+			hue_green[i] = i;
+			hue_blue[i] = 0;
+			break;
+		}
 	}
 }
 
 static void
-make_mono(const char *line, FILE *fp, enum hues hue)
+color_to_mono(struct color *color)
 {
-	const char *p = line;
+	int gray;
 
-	while (*p != '\0') {
-		struct color *color;
-		size_t len;
+	gray = red_gray[color->r] + green_gray[color->g] +
+	    blue_gray[color->b];
 
-		if ((color = parse_hexcolor(p, &len)) != NULL ||
-		    (color = parse_rgbcolor(p, &len)) != NULL) {
-			color_to_mono(color, hue);
-			print_color(color, fp);
-			free(color);
+	color->r = hue_red[gray];
+	color->g = hue_green[gray];
+	color->b = hue_blue[gray];
+}
+
+/*
+ * Copy text up to the next '#', 'r' or 'h' in one go, then try to parse
+ * a color there. Returns where it stopped, which is before end when a
+ * color may continue in input that has not been read yet.
+ */
+static const char *
+make_mono(struct mono *m, const char *p, const char *end, int eof)
+{
+	while (p < end) {
+		const char *q = p, *r;
+		struct color color;
+
+		while (q < end && !starts_color[(unsigned char)*q])
+			++q;
+		put_bytes(m, p, q - p);
+		if (q == end)
+			break;
+
+		if (*q == '#')
+			r = parse_hexcolor(q, end, &color);
+		else if (*q == 'r')
+			r = parse_rgbcolor(q, end, &color);
+		else
+			r = parse_hslcolor(q, end, &color);
+
+		/* A color that reaches the end may go on after it. */
+		if (!eof && (r == more || r == end))
+			return q;
+
+		if (r != NULL && r != more) {
+			color_to_mono(&color);
+			print_color(m, &color);
+			++m->counts.colors;
+			p = r;
 		} else {
-			fputc(*p, fp);
-			len = 1;
+			put_bytes(m, q, 1);
+			p = q + 1;
 		}
+	}
+
+	return end;
+}
+
+/*
+ * Convert in to out, returns 0 or an errno value.
+ */
+static int
+convert(struct mono *m)
+{
+	struct reader *in = &m->in;
+
+	do {
+		const char *p, *rest;
+		size_t len;
+
+		len = reader_fill(in, READER_BUFSIZE);
+		p = (const char *)in->buf + in->pos;
+		rest = make_mono(m, p, p + len, in->eof);
+
+		/* Nothing that fills the whole buffer is a color. */
+		if (rest == p && len == in->size - READER_PUSHBACK) {
+			put_bytes(m, p, 1);
+			++rest;
+		}
+		in->pos += rest - p;
+	} while (!in->eof && m->out.error == 0);
+
+	return in->error != 0 ? in->error : writer_flush(&m->out);
+}
+
+static int
+convert_file(struct mono *m, const struct job *job)
+{
+	struct stat st;
+	unsigned long colors = m->counts.colors;
+	char *tmp;
+	int fd, error = 0;
+
+	tmp = xmalloc(strlen(job->dst) + sizeof(".XXXXXX"));
+	sprintf(tmp, "%s.XXXXXX", job->dst);
+
+	if ((error = reader_open(&m->in, job->src)) != 0)
+		goto out;
+	if (fstat(m->in.fd, &st) != 0 || (fd = mkstemp(tmp)) == -1) {
+		error = errno;
+		goto close;
+	}
+	if (fchmod(fd, st.st_mode & 07777) != 0) {
+		error = errno;
+		close(fd);
+		unlink(tmp);
+		goto close;
+	}
 
-		p += len;
+	writer_init(&m->out, fd, tmp);
+	error = convert(m);
+	if (writer_close(&m->out) != 0 && error == 0)
+		error = m->out.error;
+	if (error == 0 && rename(tmp, job->dst) != 0)
+		error = errno;
+	if (error != 0)
+		unlink(tmp);
+	else {
+		++m->counts.files;
+		m->counts.nread += m->in.nread;
+		m->counts.nwritten += m->out.nwritten;
 	}
+
+close:
+	reader_close(&m->in);
+out:
+	/* Only files that were converted count, failures on their own. */
+	if (error != 0) {
+		fprintf(stderr, "%s: %s\n", job->src, strerror(error));
+		m->counts.colors = colors;
+		++m->counts.failed;
+	}
+	free(tmp);
+
+	return error;
 }
 
-static enum hues
-get_hue(int argc, char **argv)
+static void
+add_job(struct batch *b, char *src, char *dst)
 {
-	enum hues hue = WHITE;
+	if (b->njobs == b->maxjobs) {
+		b->maxjobs = b->maxjobs ? b->maxjobs * 2 : 64;
+		b->jobs = xrealloc(b->jobs, b->maxjobs * sizeof(*b->jobs));
+	}
 
-	if (argc < 2)
-		return hue;
+	b->jobs[b->njobs].src = src;
+	b->jobs[b->njobs].dst = dst;
+	++b->njobs;
+}
 
-	if (argv[1][0] == '-') {
-		switch (argv[1][1]) {
+static void
+make_dir(const char *path)
+{
+	if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Add the regular files under dir, mirroring the tree under outdir if
+ * there is one. Symbolic links are not followed, nor is the outdir when
+ * it is inside dir.
+ */
+static void
+add_dir(struct batch *b, const char *dir, const char *outdir)
+{
+	struct dirent *ent;
+	DIR *dp;
+
+	if ((dp = opendir(dir)) == NULL) {
+		perror(dir);
+		b->failed = 1;
+		return;
+	}
+	if (outdir != NULL)
+		make_dir(outdir);
+
+	while ((ent = readdir(dp)) != NULL) {
+		struct stat st;
+		char *src, *dst;
+
+		if (strcmp(ent->d_name, ".") == 0 ||
+		    strcmp(ent->d_name, "..") == 0)
+			continue;
+
+		src = join_path(dir, ent->d_name);
+		dst = outdir != NULL ? join_path(outdir, ent->d_name) : NULL;
+		if (lstat(src, &st) != 0) {
+			perror(src);
+			b->failed = 1;
+		} else if (S_ISDIR(st.st_mode)) {
+			if (outdir == NULL || st.st_dev != b->outdev ||
+			    st.st_ino != b->outino)
+				add_dir(b, src, dst);
+		} else if (S_ISREG(st.st_mode)) {
+			add_job(b, src, dst != NULL ? dst : src);
+			continue;
+		}
+		free(src);
+		free(dst);
+	}
+
+	closedir(dp);
+}
+
+static void
+add_path(struct batch *b, char *path, const char *outdir)
+{
+	struct stat st;
+	char *dst = path;
+
+	if (stat(path, &st) != 0) {
+		perror(path);
+		b->failed = 1;
+	} else if (S_ISDIR(st.st_mode))
+		add_dir(b, path, outdir);
+	else {
+		if (outdir != NULL) {
+			const char *name = strrchr(path, '/');
+
+			dst = join_path(outdir, name != NULL ? name + 1 : path);
+		}
+		add_job(b, path, dst);
+	}
+}
+
+static void
+add_counts(struct counts *total, const struct counts *c)
+{
+	__atomic_fetch_add(&total->files, c->files, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&total->failed, c->failed, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&total->colors, c->colors, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&total->nread, c->nread, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&total->nwritten, c->nwritten, __ATOMIC_RELAXED);
+}
+
+static void
+count_stats(const struct counts *c)
+{
+	stats_count("files", c->files);
+	stats_count("failed", c->failed);
+	stats_count("colors", c->colors);
+	stats_count("bytes_read", c->nread);
+	stats_count("bytes_written", c->nwritten);
+}
+
+static void *
+batch_worker(void *arg)
+{
+	struct batch *b = arg;
+	struct mono *m;
+	int i;
+
+	m = xmalloc(sizeof(*m));
+	memset(&m->counts, 0, sizeof(m->counts));
+	while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) <
+	    b->njobs)
+		if (convert_file(m, &b->jobs[i]) != 0)
+			__atomic_store_n(&b->failed, 1, __ATOMIC_RELAXED);
+	add_counts(&b->counts, &m->counts);
+	free(m);
+
+	return NULL;
+}
+
+static void
+run_batch(struct batch *b, int nthreads)
+{
+	pthread_t *threads;
+	int i;
+
+	if (nthreads > b->njobs)
+		nthreads = b->njobs > 0 ? b->njobs : 1;
+
+	threads = xmalloc(nthreads * sizeof(*threads));
+	for (i = 0; i < nthreads; ++i)
+		if (pthread_create(&threads[i], NULL, batch_worker, b) != 0) {
+			fprintf(stderr, "pthread_create failed.\n");
+			exit(EXIT_FAILURE);
+		}
+	for (i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "usage: makemono [-acgvw] < in > out\n"
+	    "       makemono [-acgvw] [-j jobs] [-o outdir] file|dir ...\n\n"
+	    "files are converted in place unless an outdir is given,\n"
+	    "0 jobs is one per cpu.\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct batch batch;
+	struct stat st;
+	struct mono *m;
+	const char *outdir = NULL;
+	enum hues hue = WHITE;
+	unsigned long clock;
+	int nthreads = 1, verbose = 0;
+	int ch, i;
+
+	while ((ch = getopt(argc, argv, "acgj:o:vw")) != -1) {
+		switch (ch) {
 		case 'a':
 			hue = AMBER;
 			break;
@@ -207,25 +889,73 @@ get_hue(int argc, char **argv)
 		case 'g':
 			hue = GREEN;
 			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads == 0)
+				nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+			if (nthreads < 1)
+				usage();
+			break;
+		case 'o':
+			outdir = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
 		case 'w':
 			hue = WHITE;
 			break;
+		default:
+			usage();
 		}
 	}
+	argc -= optind;
+	argv += optind;
+
+	stats_init("makemono", verbose);
+	clock = stats_clock();
+	init_tables(hue);
+	stats_lap("init", &clock);
+
+	if (argc == 0) {
+		int error;
+
+		m = xmalloc(sizeof(*m));
+		memset(&m->counts, 0, sizeof(m->counts));
+		reader_init(&m->in, STDIN_FILENO, "stdin");
+		writer_init(&m->out, STDOUT_FILENO, "stdout");
+		if ((error = convert(m)) != 0 ||
+		    (error = writer_close(&m->out)) != 0) {
+			fprintf(stderr, "makemono: %s\n", strerror(error));
+			return 1;
+		}
+		reader_close(&m->in);
+		stats_lap("convert", &clock);
+		m->counts.nread = m->in.nread;
+		m->counts.nwritten = m->out.nwritten;
+		count_stats(&m->counts);
+		free(m);
 
-	return hue;
-}
-
-int
-main(int argc, char **argv)
-{
-	char line[MAXLINELEN];
-	enum hues hue;
+		return 0;
+	}
 
-	hue = get_hue(argc, argv);
+	memset(&batch, 0, sizeof(batch));
+	if (outdir != NULL) {
+		make_dir(outdir);
+		if (stat(outdir, &st) != 0) {
+			perror(outdir);
+			return 1;
+		}
+		batch.outdev = st.st_dev;
+		batch.outino = st.st_ino;
+	}
+	for (i = 0; i < argc; ++i)
+		add_path(&batch, argv[i], outdir);
+	stats_lap("scan", &clock);
 
-	while (fgets(line, sizeof(line), stdin) != NULL)
-		make_mono(line, stdout, hue);
+	run_batch(&batch, nthreads);
+	stats_lap("convert", &clock);
+	count_stats(&batch.counts);
 
-	return 0;
+	return batch.failed ? 1 : 0;
 }
@@ -0,0 +1,1003 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include <netpbm/pam.h>
+
+#include "colorspace.h"
+#include "ordered.h"
+
+typedef unsigned int uint;
+typedef unsigned char uchar;
+
+enum RGB { R, G, B };
+
+#define MAXPALETTE 256
+
+static int palette[MAXPALETTE][3];
+static int palette_size;
+
+struct builtin {
+	const char *name;
+	const char *description;
+	int size;
+	int colors[16][3];
+};
+
+static const struct builtin builtins[] = {
+	{ "cga0-low", "CGA Palette 0 low intensity", 4, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x00, 0xaa, 0x00 },
+		{ 0xaa, 0x00, 0x00 },
+		{ 0xaa, 0x55, 0x00 },
+	} },
+	{ "cga0-high", "CGA Palette 0 high intensity", 4, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x55, 0xff, 0x55 },
+		{ 0xff, 0x55, 0x55 },
+		{ 0xff, 0xff, 0x55 },
+	} },
+	{ "cga1-low", "CGA Palette 1 low intensity", 4, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x00, 0xaa, 0xaa },
+		{ 0xaa, 0x00, 0xaa },
+		{ 0xaa, 0xaa, 0xaa },
+	} },
+	{ "cga1-high", "CGA Palette 1 high intensity", 4, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x55, 0xff, 0xff },
+		{ 0xff, 0x55, 0xff },
+		{ 0xff, 0xff, 0xff },
+	} },
+	{ "cga5-low", "CGA Mode5 low intensity", 4, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x00, 0xaa, 0xaa },
+		{ 0xaa, 0x00, 0x00 },
+		{ 0xaa, 0xaa, 0xaa },
+	} },
+	{ "cga5-high", "CGA Mode5 high intensity", 4, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x55, 0xff, 0xff },
+		{ 0xff, 0x55, 0x55 },
+		{ 0xff, 0xff, 0xff },
+	} },
+	{ "cga", "CGA Full palette", 16, {
+		{ 0x00, 0x00, 0x00 },
+		{ 0x00, 0x00, 0xaa },
+		{ 0x00, 0xaa, 0x00 },
+		{ 0x00, 0xaa, 0xaa },
+		{ 0xaa, 0x00, 0x00 },
+		{ 0xaa, 0x00, 0xaa },
+		{ 0xaa, 0x55, 0x00 },
+		{ 0xaa, 0xaa, 0xaa },
+		{ 0x55, 0x55, 0x55 },
+		{ 0x55, 0x55, 0xff },
+		{ 0x55, 0xff, 0x55 },
+		{ 0x55, 0xff, 0xff },
+		{ 0xff, 0x55, 0x55 },
+		{ 0xff, 0x55, 0xff },
+		{ 0xff, 0xff, 0x55 },
+		{ 0xff, 0xff, 0xff },
+	} },
+};
+
+#define NBUILTINS (int)(sizeof(builtins) / sizeof(builtins[0]))
+
+/*
+ * Threshold texture, tiled over the image. Thresholds are 0..255 and a
+ * sample v is brightened to v + v * t / 256 before the palette lookup.
+ */
+static uchar *texture;
+static int texture_width, texture_height;
+
+#define MAXBAYER 64
+
+/*
+ * Bayer matrix of size x size, size a power of two. The lowest bits of
+ * x and y pick the top bits of the rank through the 2x2 pattern
+ * 0 2 / 3 1, so neighbours are as far apart in rank as possible.
+ * Ranks are scaled to 0..255, which for the 8x8 matrix is exactly 4
+ * times its 0..63 entries.
+ */
+static void
+make_bayer(int size)
+{
+	static const int m2[2][2] = { { 0, 2 }, { 3, 1 } };
+	int x, y;
+
+	free(texture);
+	texture = malloc(size * size);
+	if (texture == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	texture_width = texture_height = size;
+
+	for (y = 0; y < size; ++y) {
+		for (x = 0; x < size; ++x) {
+			long rank = 0;
+			int n;
+
+			for (n = 1; n < size; n *= 2)
+				rank = rank * 4 + m2[y / n & 1][x / n & 1];
+			texture[y * size + x] = rank * 256 /
+			    ((long)size * size);
+		}
+	}
+}
+
+/*
+ * Threshold texture from a PGM, like a blue noise mask. Samples are
+ * scaled to 0..255.
+ */
+static void
+load_texture(const char *path)
+{
+	struct pam pam;
+	tuple *row;
+	FILE *f;
+	int x, y;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	pnm_readpaminit(f, &pam, PAM_STRUCT_SIZE(tuple_type));
+	if (pam.depth != 1) {
+		fprintf(stderr, "%s: threshold texture should be gray.\n",
+		    path);
+		exit(1);
+	}
+
+	free(texture);
+	texture = malloc((size_t)pam.width * pam.height);
+	if (texture == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+	texture_width = pam.width;
+	texture_height = pam.height;
+
+	row = pnm_allocpamrow(&pam);
+	for (y = 0; y < pam.height; ++y) {
+		pnm_readpamrow(&pam, row);
+		for (x = 0; x < pam.width; ++x)
+			texture[y * pam.width + x] =
+			    row[x][0] * 256 / (pam.maxval + 1);
+	}
+	pnm_freepamrow(row);
+	fclose(f);
+}
+
+/*
+ * A number selects a bayer matrix of that size, anything else is
+ * loaded as a texture.
+ */
+void
+ordered_texture(const char *arg)
+{
+	char *end;
+	long size;
+
+	size = strtol(arg, &end, 10);
+	if (*end != '\0') {
+		load_texture(arg);
+		return;
+	}
+
+	if (size < 2 || size > MAXBAYER || (size & (size - 1)) != 0) {
+		fprintf(stderr, "matrix size should be a power of two "
+		    "from 2 to %d.\n", MAXBAYER);
+		exit(1);
+	}
+	make_bayer(size);
+}
+
+static void *
+xrealloc(void *ptr, size_t size)
+{
+	void *new_ptr;
+
+	new_ptr = realloc(ptr, size);
+	if (new_ptr == NULL) {
+		perror("realloc");
+		exit(1);
+	}
+
+	return new_ptr;
+}
+
+static void
+add_color(int r, int g, int b, const char *path)
+{
+	int i;
+
+	if (r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255) {
+		fprintf(stderr, "%s: invalid color %d %d %d.\n", path, r, g, b);
+		exit(1);
+	}
+
+	for (i = 0; i < palette_size; ++i)
+		if (palette[i][R] == r && palette[i][G] == g &&
+		    palette[i][B] == b)
+			return;
+
+	if (palette_size == MAXPALETTE) {
+		fprintf(stderr, "%s: more than %d colors.\n", path, MAXPALETTE);
+		exit(1);
+	}
+
+	palette[palette_size][R] = r;
+	palette[palette_size][G] = g;
+	palette[palette_size][B] = b;
+	++palette_size;
+}
+
+/*
+ * GIMP palette: a "GIMP Palette" line, optional Name: and Columns:
+ * lines, comments starting with # and one "red green blue [name]"
+ * line per color.
+ */
+static void
+load_gpl(FILE *f, const char *path)
+{
+	char line[256];
+	int lineno = 0;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		int r, g, b;
+
+		if (++lineno == 1) {
+			if (strncmp(line, "GIMP Palette", 12) != 0) {
+				fprintf(stderr, "%s: not a GIMP palette.\n",
+				    path);
+				exit(1);
+			}
+			continue;
+		}
+
+		if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#' ||
+		    strncmp(line, "Name:", 5) == 0 ||
+		    strncmp(line, "Columns:", 8) == 0)
+			continue;
+
+		if (sscanf(line, "%d %d %d", &r, &g, &b) != 3) {
+			fprintf(stderr, "%s:%d: expected red green blue.\n",
+			    path, lineno);
+			exit(1);
+		}
+		add_color(r, g, b, path);
+	}
+}
+
+/*
+ * Netpbm swatch: every distinct color in the image, in order of
+ * appearance.
+ */
+static void
+load_swatch(FILE *f, const char *path)
+{
+	struct pam pam;
+	tuple *row;
+	int x, y;
+
+	pnm_readpaminit(f, &pam, PAM_STRUCT_SIZE(tuple_type));
+	if (pam.depth < 3) {
+		fprintf(stderr, "%s: swatch should have a depth of 3.\n", path);
+		exit(1);
+	}
+
+	row = pnm_allocpamrow(&pam);
+	for (y = 0; y < pam.height; ++y) {
+		pnm_readpamrow(&pam, row);
+		for (x = 0; x < pam.width; ++x) {
+			add_color(row[x][R] * 255 / pam.maxval,
+			    row[x][G] * 255 / pam.maxval,
+			    row[x][B] * 255 / pam.maxval, path);
+		}
+	}
+	pnm_freepamrow(row);
+}
+
+/*
+ * Select a built-in palette by name or load one from a file.
+ */
+void
+ordered_palette(const char *name)
+{
+	FILE *f;
+	int ch, i;
+
+	palette_size = 0;
+
+	for (i = 0; i < NBUILTINS; ++i) {
+		if (strcmp(builtins[i].name, name) == 0) {
+			for (palette_size = 0; palette_size < builtins[i].size;
+			    ++palette_size) {
+				palette[palette_size][R] =
+				    builtins[i].colors[palette_size][R];
+				palette[palette_size][G] =
+				    builtins[i].colors[palette_size][G];
+				palette[palette_size][B] =
+				    builtins[i].colors[palette_size][B];
+			}
+			return;
+		}
+	}
+
+	f = fopen(name, "r");
+	if (f == NULL) {
+		perror(name);
+		exit(1);
+	}
+
+	ch = getc(f);
+	ungetc(ch, f);
+	if (ch == 'P')
+		load_swatch(f, name);
+	else
+		load_gpl(f, name);
+	fclose(f);
+
+	if (palette_size == 0) {
+		fprintf(stderr, "%s: no colors.\n", name);
+		exit(1);
+	}
+}
+
+static int
+pick(int *c)
+{
+	int maxdist = INT_MAX;
+	int match = 0;
+	int i;
+
+	for (i = 0; i < palette_size; ++i) {
+		int w[3] = { 3, 4, 2 };
+		int diff[3];
+		int dist;
+
+		diff[R] = abs(c[R] - palette[i][R]);
+		diff[G] = abs(c[G] - palette[i][G]);
+		diff[B] = abs(c[B] - palette[i][B]);
+
+		if ((c[R] + palette[i][R]) / 2 < 128) {
+			w[R] = 2;
+			w[B] = 3;
+		}
+
+		dist = w[R] * diff[R] + w[G] * diff[G] + w[B] * diff[B];
+		if (dist < maxdist) {
+			maxdist = dist;
+			match = i;
+		}
+	}
+
+	return match;
+}
+
+/*
+ * Same as pick() but only over a list of candidate entries, which are
+ * in palette order so ties still go to the first entry.
+ */
+static int
+pick_among(int *c, const uchar *candidates, int n)
+{
+	int maxdist = INT_MAX;
+	int match = 0;
+	int k;
+
+	for (k = 0; k < n; ++k) {
+		int i = candidates[k];
+		int w[3] = { 3, 4, 2 };
+		int diff[3];
+		int dist;
+
+		diff[R] = abs(c[R] - palette[i][R]);
+		diff[G] = abs(c[G] - palette[i][G]);
+		diff[B] = abs(c[B] - palette[i][B]);
+
+		if ((c[R] + palette[i][R]) / 2 < 128) {
+			w[R] = 2;
+			w[B] = 3;
+		}
+
+		dist = w[R] * diff[R] + w[G] * diff[G] + w[B] * diff[B];
+		if (dist < maxdist) {
+			maxdist = dist;
+			match = i;
+		}
+	}
+
+	return match;
+}
+
+/*
+ * Palette lookup table indexed by the top 6 bits of each channel. A
+ * cell holds a palette index when that entry is the closest for every
+ * color in the cell. Otherwise it holds LUT_LIST and the offset of
+ * the entries that could still win in the candidates pool: a count
+ * followed by the entries.
+ *
+ * The table is built top down over an octree of boxes, so each box
+ * only has to bound the entries its parent could not rule out.
+ */
+#define LUT_BITS 6
+#define LUT_SHIFT (8 - LUT_BITS)
+#define LUT_CELL (1 << LUT_SHIFT)
+#define LUT_LIST (1U << 31)
+
+#define LUT_INDEX(r, g, b) \
+	((r) >> LUT_SHIFT << (2 * LUT_BITS) | \
+	 (g) >> LUT_SHIFT << LUT_BITS | \
+	 (b) >> LUT_SHIFT)
+
+static unsigned int lut[1 << (3 * LUT_BITS)];
+static uchar *candidates;
+static size_t ncandidates, candidates_size;
+
+/* Search the whole palette for every pixel, see ordered_init(). */
+static int exhaustive;
+
+/*
+ * Smallest and largest distance between palette entry i and any color
+ * in the box of size starting at lo, using the weights of pick().
+ */
+static void
+box_bounds(const int *lo, int size, int i, int *lower, int *upper)
+{
+	int wmin[3] = { 2, 4, 2 }, wmax[3] = { 3, 4, 3 };
+	int dark_lo, dark_hi;
+	int c;
+
+	/* The red mean decides the weights when it is the same box-wide. */
+	dark_lo = (lo[R] + palette[i][R]) / 2 < 128;
+	dark_hi = (lo[R] + size - 1 + palette[i][R]) / 2 < 128;
+	if (dark_lo && dark_hi) {
+		wmin[R] = wmax[R] = 2;
+		wmin[B] = wmax[B] = 3;
+	} else if (!dark_lo && !dark_hi) {
+		wmin[R] = wmax[R] = 3;
+		wmin[B] = wmax[B] = 2;
+	}
+
+	*lower = *upper = 0;
+	for (c = 0; c < 3; ++c) {
+		int hi = lo[c] + size - 1;
+		int p = palette[i][c];
+		int near, far;
+
+		if (p < lo[c])
+			near = lo[c] - p;
+		else if (p > hi)
+			near = p - hi;
+		else
+			near = 0;
+
+		far = abs(p - lo[c]);
+		if (abs(p - hi) > far)
+			far = abs(p - hi);
+
+		*lower += wmin[c] * near;
+		*upper += wmax[c] * far;
+	}
+}
+
+static unsigned int
+add_candidates(const uchar *list, int n)
+{
+	size_t offset = ncandidates;
+
+	if (ncandidates + n + 1 > candidates_size) {
+		candidates_size = (candidates_size + n + 1) * 2;
+		candidates = xrealloc(candidates, candidates_size);
+	}
+
+	candidates[ncandidates++] = n - 1;
+	memcpy(candidates + ncandidates, list, n);
+	ncandidates += n;
+
+	return LUT_LIST | offset;
+}
+
+static void
+build_box(const int *lo, int size, const uchar *list, int n)
+{
+	int lower[MAXPALETTE], upper[MAXPALETTE];
+	uchar keep[MAXPALETTE];
+	int best = INT_MAX, nkeep = 0;
+	int k;
+
+	for (k = 0; k < n; ++k) {
+		box_bounds(lo, size, list[k], &lower[k], &upper[k]);
+		if (upper[k] < best)
+			best = upper[k];
+	}
+
+	/* Entries that can't beat the best upper bound never win. */
+	for (k = 0; k < n; ++k)
+		if (lower[k] <= best)
+			keep[nkeep++] = list[k];
+
+	if (nkeep == 1 || size == LUT_CELL) {
+		unsigned int entry;
+		int r, g, b;
+
+		entry = nkeep == 1 ? keep[0] : add_candidates(keep, nkeep);
+		for (r = lo[R]; r < lo[R] + size; r += LUT_CELL)
+			for (g = lo[G]; g < lo[G] + size; g += LUT_CELL)
+				for (b = lo[B]; b < lo[B] + size; b += LUT_CELL)
+					lut[LUT_INDEX(r, g, b)] = entry;
+	} else {
+		int half = size / 2;
+		int child;
+
+		for (child = 0; child < 8; ++child) {
+			int clo[3];
+
+			clo[R] = lo[R] + (child & 4 ? half : 0);
+			clo[G] = lo[G] + (child & 2 ? half : 0);
+			clo[B] = lo[B] + (child & 1 ? half : 0);
+			build_box(clo, half, keep, nkeep);
+		}
+	}
+}
+
+static void
+build_lut(void)
+{
+	uchar all[MAXPALETTE];
+	int lo[3] = { 0, 0, 0 };
+	int i;
+
+	for (i = 0; i < palette_size; ++i)
+		all[i] = i;
+
+	ncandidates = 0;
+	build_box(lo, 256, all, palette_size);
+}
+
+static int
+lookup(int *c)
+{
+	unsigned int entry = lut[LUT_INDEX(c[R], c[G], c[B])];
+	const uchar *list;
+
+	if (!(entry & LUT_LIST))
+		return entry;
+
+	list = candidates + (entry & ~LUT_LIST);
+
+	return pick_among(c, list + 1, list[0] + 1);
+}
+
+/*
+ * Build the lookup table and check it against pick() for every 8-bit
+ * color.
+ */
+int
+ordered_validate(void)
+{
+	long ncolors = 0, nambiguous = 0, nwrong = 0;
+	int c[3];
+
+	build_lut();
+
+	for (c[R] = 0; c[R] < 256; ++c[R]) {
+		for (c[G] = 0; c[G] < 256; ++c[G]) {
+			for (c[B] = 0; c[B] < 256; ++c[B]) {
+				if (lut[LUT_INDEX(c[R], c[G], c[B])] & LUT_LIST)
+					++nambiguous;
+				if (lookup(c) != pick(c))
+					++nwrong;
+				++ncolors;
+			}
+		}
+	}
+
+	printf("%d entries, %ld colors, %ld (%.1f%%) in ambiguous cells, "
+	    "%lu candidate bytes, %ld wrong.\n", palette_size, ncolors,
+	    nambiguous, nambiguous * 100.0 / ncolors,
+	    (unsigned long)ncandidates, nwrong);
+
+	return nwrong == 0;
+}
+
+/*
+ * Perceptual distance: the palette is converted once and a pixel
+ * goes to the entry nearest in euclidean distance. Converting every
+ * pixel is slow, so results are memoized in a direct mapped cache
+ * shared by all threads. An entry packs a valid bit, the part of the
+ * color hash that isn't the slot and the palette index in one word,
+ * so a racing reader sees either a whole entry or none.
+ */
+static int metric = COLOR_RGB;
+static double palette_cs[MAXPALETTE][3];
+
+#define MEMO_BITS 16
+#define MEMO_VALID (1U << 16)
+
+static unsigned int memo[1 << MEMO_BITS];
+
+/*
+ * Select the distance metric by colorspace name. Returns 0 when there
+ * is no such colorspace.
+ */
+int
+ordered_metric(const char *name)
+{
+	int space;
+
+	colorspace_init();
+	space = colorspace_find(name);
+	if (space < 0)
+		return 0;
+	metric = space;
+
+	return 1;
+}
+
+static int
+pick_perceptual(int *c)
+{
+	double maxdist = 0, p[3];
+	int match = 0;
+	int i;
+
+	colorspace_convert(metric, c, p);
+
+	for (i = 0; i < palette_size; ++i) {
+		double d0 = p[0] - palette_cs[i][0];
+		double d1 = p[1] - palette_cs[i][1];
+		double d2 = p[2] - palette_cs[i][2];
+		double dist = d0 * d0 + d1 * d1 + d2 * d2;
+
+		if (i == 0 || dist < maxdist) {
+			maxdist = dist;
+			match = i;
+		}
+	}
+
+	return match;
+}
+
+/*
+ * A bijective hash of the 24-bit color: its low bits pick the slot
+ * and the top 8 bits are enough to tell colors in a slot apart.
+ */
+static unsigned long
+memo_hash(int *c)
+{
+	unsigned long h = (unsigned long)c[R] << 16 | c[G] << 8 | c[B];
+
+	h = h * 0x9e3779UL & 0xffffff;
+	h ^= h >> 12;
+	h = h * 0x9e3779UL & 0xffffff;
+
+	return h;
+}
+
+static int
+memo_lookup(int *c)
+{
+	unsigned long h = memo_hash(c);
+	unsigned int *slot = &memo[h & ((1 << MEMO_BITS) - 1)];
+	unsigned int tag = MEMO_VALID | (h >> MEMO_BITS) << 8;
+	unsigned int entry;
+	int i;
+
+	entry = __atomic_load_n(slot, __ATOMIC_RELAXED);
+	if ((entry & ~0xffU) == tag)
+		return entry & 0xff;
+
+	i = pick_perceptual(c);
+	__atomic_store_n(slot, tag | i, __ATOMIC_RELAXED);
+
+	return i;
+}
+
+/*
+ * Palette entry for a brightened color with the selected metric.
+ */
+static int
+nearest(int *c)
+{
+	if (metric != COLOR_RGB)
+		return exhaustive ? pick_perceptual(c) : memo_lookup(c);
+
+	return exhaustive ? pick(c) : lookup(c);
+}
+
+/*
+ * Brighten a color by its threshold and return the palette entry
+ * closest to the result.
+ */
+static int
+dither_pixel(uint r, uint g, uint b, uint t)
+{
+	int c[3];
+	uint cv;
+
+	cv = r + r * t / 256;
+	c[R] = cv > 255 ? 255 : cv;
+
+	cv = g + g * t / 256;
+	c[G] = cv > 255 ? 255 : cv;
+
+	cv = b + b * t / 256;
+	c[B] = cv > 255 ? 255 : cv;
+
+	return nearest(c);
+}
+
+/*
+ * Get ready to dither with the current palette and metric: build the
+ * lookup table, or convert the palette for a perceptual metric. With
+ * full set every pixel searches the whole palette instead.
+ */
+void
+ordered_init(int full)
+{
+	int i;
+
+	exhaustive = full;
+	for (i = 0; i < palette_size; ++i)
+		colorspace_convert(metric, palette[i], palette_cs[i]);
+
+	if (!exhaustive && metric == COLOR_RGB)
+		build_lut();
+
+	if (texture == NULL)
+		make_bayer(8);
+}
+
+/*
+ * Dither row y of libnetpbm tuples in place.
+ */
+void
+ordered_tuple_row(tuple *row, int width, int y)
+{
+	const uchar *tex = texture + y % texture_height * texture_width;
+	int x;
+
+	for (x = 0; x < width; ++x) {
+		int i;
+
+		i = dither_pixel(row[x][R], row[x][G], row[x][B],
+		    tex[x % texture_width]);
+		row[x][R] = palette[i][R];
+		row[x][G] = palette[i][G];
+		row[x][B] = palette[i][B];
+	}
+}
+
+/*
+ * Row kernels for packed rows: brighten n samples by their thresholds,
+ * v + v * t / 256 clamped to 255, same as dither_pixel(). v * t fits
+ * in 16 bits so the vector versions widen, multiply, shift and pack back
+ * with unsigned saturation doing the clamp.
+ */
+typedef void (*brighten_fn)(uchar *, const uchar *, const uchar *, size_t);
+
+static void
+brighten_scalar(uchar *dst, const uchar *src, const uchar *thresh, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		uint cv = src[i] + src[i] * thresh[i] / 256;
+
+		dst[i] = cv > 255 ? 255 : cv;
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2"))) static void
+brighten_sse2(uchar *dst, const uchar *src, const uchar *thresh, size_t n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i t = _mm_loadu_si128((const __m128i *)(thresh + i));
+		__m128i vlo = _mm_unpacklo_epi8(v, zero);
+		__m128i vhi = _mm_unpackhi_epi8(v, zero);
+		__m128i lo, hi;
+
+		lo = _mm_srli_epi16(_mm_mullo_epi16(vlo,
+		    _mm_unpacklo_epi8(t, zero)), 8);
+		hi = _mm_srli_epi16(_mm_mullo_epi16(vhi,
+		    _mm_unpackhi_epi8(t, zero)), 8);
+		lo = _mm_add_epi16(lo, vlo);
+		hi = _mm_add_epi16(hi, vhi);
+		_mm_storeu_si128((__m128i *)(dst + i),
+		    _mm_packus_epi16(lo, hi));
+	}
+
+	brighten_scalar(dst + i, src + i, thresh + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+brighten_avx2(uchar *dst, const uchar *src, const uchar *thresh, size_t n)
+{
+	size_t i;
+
+	/* Widening per 16 bytes keeps packus from interleaving lanes. */
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i vlo, vhi, lo, hi;
+
+		vlo = _mm256_cvtepu8_epi16(
+		    _mm_loadu_si128((const __m128i *)(src + i)));
+		vhi = _mm256_cvtepu8_epi16(
+		    _mm_loadu_si128((const __m128i *)(src + i + 16)));
+		lo = _mm256_mullo_epi16(vlo, _mm256_cvtepu8_epi16(
+		    _mm_loadu_si128((const __m128i *)(thresh + i))));
+		hi = _mm256_mullo_epi16(vhi, _mm256_cvtepu8_epi16(
+		    _mm_loadu_si128((const __m128i *)(thresh + i + 16))));
+		lo = _mm256_add_epi16(_mm256_srli_epi16(lo, 8), vlo);
+		hi = _mm256_add_epi16(_mm256_srli_epi16(hi, 8), vhi);
+		_mm256_storeu_si256((__m256i *)(dst + i),
+		    _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi),
+		    0xd8));
+	}
+
+	brighten_scalar(dst + i, src + i, thresh + i, n - i);
+}
+#endif
+
+static const struct {
+	const char *name;
+	brighten_fn fn;
+} simd[] = {
+#ifdef HAVE_X86_SIMD
+	{ "avx2", brighten_avx2 },
+	{ "sse2", brighten_sse2 },
+#endif
+	{ "scalar", brighten_scalar }
+};
+
+#define NSIMD (int)(sizeof(simd) / sizeof(simd[0]))
+
+static int
+simd_supported(const char *name)
+{
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (strcmp(name, "avx2") == 0)
+		return __builtin_cpu_supports("avx2");
+	if (strcmp(name, "sse2") == 0)
+		return __builtin_cpu_supports("sse2");
+#endif
+	return strcmp(name, "scalar") == 0;
+}
+
+static brighten_fn brighten;
+
+/*
+ * Pick the row kernel by name, or the best one this cpu supports when
+ * name is NULL.
+ */
+void
+ordered_simd(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NSIMD; ++i) {
+		if (name == NULL ? simd_supported(simd[i].name) :
+		    strcmp(simd[i].name, name) == 0)
+			break;
+	}
+
+	if (i == NSIMD || !simd_supported(simd[i].name)) {
+		fprintf(stderr, "%s: not supported.\n", name);
+		exit(1);
+	}
+
+	brighten = simd[i].fn;
+}
+
+/*
+ * Packed rows have each row of the threshold texture laid out once
+ * over a whole image row, so the row kernel can run over the samples
+ * as a flat array whatever the texture size. Samples past the first
+ * three, like alpha, get a threshold of zero so they pass through
+ * unchanged.
+ */
+static uchar *thresholds;
+static int row_width, row_depth;
+static size_t rowbytes;
+
+/*
+ * Set up ordered_row() for rows of width pixels of depth samples.
+ */
+void
+ordered_rows(int width, int depth)
+{
+	int x, y;
+
+	if (brighten == NULL)
+		ordered_simd(NULL);
+
+	row_width = width;
+	row_depth = depth;
+	rowbytes = (size_t)width * depth;
+
+	free(thresholds);
+	thresholds = malloc(rowbytes * texture_height + 1);
+	if (thresholds == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (y = 0; y < texture_height; ++y) {
+		const uchar *tex = texture + y * texture_width;
+		uchar *t = thresholds + y * rowbytes;
+
+		memset(t, 0, rowbytes);
+		for (x = 0; x < width; ++x) {
+			t[R] = t[G] = t[B] = tex[x % texture_width];
+			t += depth;
+		}
+	}
+}
+
+/*
+ * Dither packed row y from src into dst, which may be the same buffer.
+ */
+void
+ordered_row(uchar *dst, const uchar *src, int y)
+{
+	uchar *q = dst;
+	int x;
+
+	brighten(dst, src, thresholds + y % texture_height * rowbytes,
+	    rowbytes);
+
+	for (x = 0; x < row_width; ++x) {
+		int c[3];
+		int i;
+
+		c[R] = q[R];
+		c[G] = q[G];
+		c[B] = q[B];
+		i = nearest(c);
+		q[R] = palette[i][R];
+		q[G] = palette[i][G];
+		q[B] = palette[i][B];
+		q += row_depth;
+	}
+}
+
+/*
+ * List the built-in palettes and the row kernels, for usage messages.
+ */
+void
+ordered_list_palettes(FILE *f)
+{
+	int i;
+
+	fprintf(f, "palette is a GIMP palette, a netpbm swatch or one of:\n");
+	for (i = 0; i < NBUILTINS; ++i)
+		fprintf(f, "  %-10s %s\n", builtins[i].name,
+		    builtins[i].description);
+}
+
+void
+ordered_list_simd(FILE *f)
+{
+	int i;
+
+	fprintf(f, "simd is one of:");
+	for (i = 0; i < NSIMD; ++i)
+		fprintf(f, " %s", simd[i].name);
+	fprintf(f, "\n");
+}
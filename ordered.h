@@ -0,0 +1,26 @@
+#ifndef ORDERED_H
+#define ORDERED_H
+
+/*
+ * Ordered dithering to a palette: every sample is brightened by a
+ * threshold from a tiled texture, a bayer matrix by default, and the
+ * pixel becomes the nearest palette entry. Set up the palette, metric
+ * and texture first, then call ordered_init().
+ */
+#define ORDERED_DEFAULT_PALETTE "cga5-low"
+
+void ordered_palette(const char *);
+int ordered_metric(const char *);
+void ordered_texture(const char *);
+void ordered_simd(const char *);
+void ordered_init(int);
+int ordered_validate(void);
+
+void ordered_tuple_row(tuple *, int, int);
+void ordered_rows(int, int);
+void ordered_row(unsigned char *, const unsigned char *, int);
+
+void ordered_list_palettes(FILE *);
+void ordered_list_simd(FILE *);
+
+#endif
@@ -0,0 +1,63 @@
+#! /bin/sh
+#
+# Feed random and truncated streams to the decoder and check that it
+# either decodes them or fails cleanly, never crashes.
+#
+
+prg="${1:-./packbits}"
+rounds="${2:-200}"
+
+set -eu
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+die() {
+    printf "fuzz: %s\n" "$*" >&2
+    exit 1
+}
+
+# Exit status 0 or 1 is fine, anything else means the decoder crashed.
+decode() {
+    status=0
+    "$prg" -d "$1" "$tmpdir/out" 2>"$tmpdir/err" || status=$?
+    [ "$status" -le 1 ] || die "$2: decoder exited with $status."
+    if [ "$status" -eq 1 ]; then
+        grep -q "^offset [0-9]*: truncated" "$tmpdir/err" ||
+            die "$2: failure without an offset."
+    fi
+    return "$status"
+}
+
+# Random streams; every byte is a valid header so only truncation can
+# be detected.
+i=0
+while [ "$i" -lt "$rounds" ]; do
+    size=$(od -An -N2 -tu2 /dev/urandom | tr -d ' ')
+    head -c "$size" /dev/urandom > "$tmpdir/random"
+    decode "$tmpdir/random" "random stream of $size bytes" || true
+    i=$((i + 1))
+done
+
+# Truncated streams must decode to a prefix of the original or fail.
+head -c 65536 /dev/urandom > "$tmpdir/orig"
+head -c 16384 /dev/zero >> "$tmpdir/orig"
+cat "$prg" >> "$tmpdir/orig"
+"$prg" -c "$tmpdir/orig" "$tmpdir/orig.pb"
+"$prg" -d "$tmpdir/orig.pb" "$tmpdir/check"
+cmp -s "$tmpdir/orig" "$tmpdir/check" || die "round trip failed."
+
+total=$(wc -c < "$tmpdir/orig.pb")
+i=0
+while [ "$i" -lt "$rounds" ]; do
+    cut=$(( $(od -An -N4 -tu4 /dev/urandom | tr -d ' ') % total ))
+    head -c "$cut" "$tmpdir/orig.pb" > "$tmpdir/cut"
+    if decode "$tmpdir/cut" "stream cut at $cut of $total"; then
+        n=$(wc -c < "$tmpdir/out")
+        head -c "$n" "$tmpdir/orig" | cmp -s - "$tmpdir/out" ||
+            die "stream cut at $cut decoded to garbage."
+    fi
+    i=$((i + 1))
+done
+
+printf "fuzz: %d random and %d truncated streams ok.\n" "$rounds" "$rounds"
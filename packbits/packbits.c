@@ -1,73 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdarg.h>
 #include <string.h>
 
-void
-die(char *fmt, ...)
-{
-	va_list ap;
-
-	va_start(ap, fmt);
-
-	if (fmt && fmt[strlen(fmt) - 1] == ':') {
-		vfprintf(stderr, "%s: ", ap);
-		perror(NULL);
-	} else
-		fprintf(stderr, "%s\n", fmt);
-
-	va_end(ap);
-
-	exit(1);
-}
-
-int
-xfputc(int c, FILE *f)
-{
-	int cc;
-
-	cc = fputc(c, f);
-	if (cc == EOF)
-		die("fputc:");
-
-	return cc;
-}
-
-size_t
-xfwrite(const void *p, size_t size, size_t nmemb, FILE *f)
-{
-	size_t nwritten;
-
-	nwritten = fwrite(p, size, nmemb, f);
-	if (nwritten != nmemb)
-		die("fwrite:");
-
-	return nwritten;
-}
+#include "common.h"
+#include "stats.h"
 
-FILE *
-xfopen(const char *pathname, const char *mode)
-{
-	FILE *f;
-
-	f = fopen(pathname, mode);
-	if (f == NULL)
-		die("fopen: %s:", pathname);
-
-	return f;
-}
+#define MAXLITERAL 128
 
 int
-compress(FILE *infile, FILE *outfile)
+compress(struct reader *infile, struct writer *outfile)
 {
+	unsigned long runs = 0, literals = 0;
 	int ch, next, count;
 
-	while ((ch = fgetc(infile)) != EOF) {
-		next = fgetc(infile);
+	while ((ch = READ_BYTE(infile)) != EOF) {
+		next = READ_BYTE(infile);
 
 		if (next == EOF) {
-			xfputc(0, outfile);
-			xfputc(ch, outfile);
+			WRITE_BYTE(outfile, 0);
+			WRITE_BYTE(outfile, ch);
+			++literals;
 
 			break;
 		}
@@ -75,11 +27,12 @@ compress(FILE *infile, FILE *outfile)
 		if (next == ch) {
 			count = 2;
 
-			while ((next = fgetc(infile)) == ch && count < 129)
+			while ((next = READ_BYTE(infile)) == ch && count < 129)
 				++count;
 
-			xfputc(-(count - 1), outfile);
-			xfputc(ch, outfile);
+			WRITE_BYTE(outfile, -(count - 1));
+			WRITE_BYTE(outfile, ch);
+			++runs;
 		} else {
 			unsigned char buf[128];
 
@@ -87,77 +40,140 @@ compress(FILE *infile, FILE *outfile)
 			buf[1] = next;
 			count = 2;
 
-			while ((next = fgetc(infile)) != buf[count - 1]
+			while ((next = READ_BYTE(infile)) != buf[count - 1]
 			    && next != EOF && count < 128)
 				buf[count++] = next;
 
+			/* Put back both bytes of the run that starts here. */
 			if (next == buf[count - 1]) {
-				ungetc(next, infile);
+				UNREAD_BYTE(infile);
 				--count;
 			}
 
-			xfputc(count - 1, outfile);
-			xfwrite(buf, count, 1, outfile);
+			WRITE_BYTE(outfile, count - 1);
+			writer_write(outfile, buf, count);
+			++literals;
 		}
-		ungetc(next, infile);
+		if (next != EOF)
+			UNREAD_BYTE(infile);
 	}
 
+	stats_count("runs", runs);
+	stats_count("literals", literals);
+
 	return 0;
 }
 
+/*
+ * Every header is checked against the input that is left so a
+ * truncated or corrupted stream is reported instead of being
+ * silently decoded to garbage. Runs and literals are copied with
+ * memset and memcpy straight between the reader and writer buffers.
+ */
 int
-decompress(FILE *infile, FILE *outfile)
+decompress(struct reader *infile, struct writer *outfile)
 {
-	int count;
+	unsigned long runs = 0, literals = 0;
+	long offset = 0;
 
-	while ((count = fgetc(infile)) != EOF) {
-		if (count > 127) {
-			int ch;
+	for (;;) {
+		size_t avail = infile->len - infile->pos;
+		const unsigned char *in;
+		unsigned char *out;
+		int count;
+
+		/* Keep at least one header and its longest literal buffered. */
+		if (avail < MAXLITERAL + 1)
+			avail = reader_fill(infile, MAXLITERAL + 1);
+
+		if (avail == 0)
+			break;
 
+		if (outfile->len > WRITER_BUFSIZE - MAXLITERAL - 1)
+			writer_flush(outfile);
+
+		in = infile->buf + infile->pos;
+		out = outfile->buf + outfile->len;
+		count = in[0];
+		if (count > 127) {
 			count = 257 - count;
-			ch = fgetc(infile);
-			while (count-- > 0)
-				xfputc(ch, outfile);
+			if (avail < 2) {
+				fprintf(stderr, "offset %ld: truncated run of "
+				    "%d bytes.\n", offset, count);
+				return -1;
+			}
+
+			memset(out, in[1], count);
+			++runs;
+			outfile->len += count;
+			infile->pos += 2;
+			offset += 2;
 		} else {
 			++count;
-			while (count-- > 0) {
-				int ch;
-
-				ch = fgetc(infile);
-				xfputc(ch, outfile);
+			if (avail - 1 < (size_t)count) {
+				fprintf(stderr, "offset %ld: truncated literal "
+				    "of %d bytes, %lu left.\n", offset, count,
+				    (unsigned long)(avail - 1));
+				return -1;
 			}
+
+			memcpy(out, in + 1, count);
+			++literals;
+			outfile->len += count;
+			infile->pos += count + 1;
+			offset += count + 1;
 		}
 	}
 
+	stats_count("runs", runs);
+	stats_count("literals", literals);
+
 	return 0;
 }
 
 int
 main(int argc, char **argv)
 {
-	FILE *infile, *outfile;
+	struct reader infile;
+	struct writer outfile;
+	unsigned long clock;
+	int error;
 
 	if (argc != 4 || argv[1][1] == '\0')
 		die("args");
 
-	infile = xfopen(argv[2], "rb");
-	outfile = xfopen(argv[3], "wb");
+	stats_init("packbits", 0);
+	clock = stats_clock();
+
+	if (reader_open(&infile, argv[2]) != 0)
+		die("open: %s:", argv[2]);
+	if (writer_open(&outfile, argv[3]) != 0)
+		die("open: %s:", argv[3]);
+	stats_lap("open", &clock);
 
 	switch (argv[1][1]) {
 	case 'c':
 	case 'C':
-		compress(infile, outfile);
+		compress(&infile, &outfile);
+		stats_lap("compress", &clock);
 		break;
 	case 'd':
 	case 'D':
-		decompress(infile, outfile);
+		if (decompress(&infile, &outfile) != 0)
+			die("%s: corrupt packbits stream.", argv[2]);
+		stats_lap("decompress", &clock);
 		break;
 	default:
 		die("args");
 	}
 
-	fclose(infile);
-	fclose(outfile);
+	if ((error = reader_close(&infile)) != 0)
+		die("read: %s: %s", argv[2], strerror(error));
+	if ((error = writer_close(&outfile)) != 0)
+		die("write: %s: %s", argv[3], strerror(error));
+	stats_lap("close", &clock);
+	stats_count("bytes_read", infile.nread);
+	stats_count("bytes_written", outfile.nwritten);
 
 	return 0;
 }
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "packets.h"
+
+void
+packet_init(struct packet_reader *pr, FILE *file)
+{
+	pr->file = file;
+	pr->pos = pr->len = 0;
+	pr->eof = pr->overlong = 0;
+	pr->lines = pr->skipped = 0;
+}
+
+/*
+ * Parse seconds with up to six decimals, or N/A. Returns a pointer past
+ * the field or NULL.
+ */
+static const char *
+parse_time(const char *p, const char *end, double *usec, int *has)
+{
+	double sec = 0, frac = 0, scale = 100000;
+	int neg = 0;
+	const char *digits;
+
+	if (end - p >= 3 && memcmp(p, "N/A", 3) == 0) {
+		*has = 0;
+		return p + 3;
+	}
+
+	if (p < end && *p == '-') {
+		neg = 1;
+		++p;
+	}
+	for (digits = p; p < end && *p >= '0' && *p <= '9'; ++p)
+		sec = sec * 10 + (*p - '0');
+	if (p == digits)
+		return NULL;
+	if (p < end && *p == '.')
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+			frac += (*p - '0') * scale;
+			scale /= 10;
+		}
+
+	*usec = (sec * 1000000 + (long)frac) * (neg ? -1 : 1);
+	*has = 1;
+	return p;
+}
+
+static const char *
+parse_size(const char *p, const char *end, long *size)
+{
+	const char *digits;
+
+	for (digits = p, *size = 0; p < end && *p >= '0' && *p <= '9'; ++p)
+		*size = *size * 10 + (*p - '0');
+
+	return p == digits ? NULL : p;
+}
+
+static int
+parse_line(const char *p, const char *end, struct packet *pkt)
+{
+	if ((p = parse_time(p, end, &pkt->pts, &pkt->has_pts)) == NULL ||
+	    p == end || *p++ != ',' ||
+	    (p = parse_time(p, end, &pkt->dts, &pkt->has_dts)) == NULL ||
+	    p == end || *p++ != ',' ||
+	    (p = parse_size(p, end, &pkt->size)) == NULL ||
+	    (p < end && *p != ',' && *p != '\r'))
+		return 0;
+
+	if (pkt->has_pts)
+		pkt->time = pkt->pts;
+	else if (pkt->has_dts)
+		pkt->time = pkt->dts;
+	else
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Get the next packet, returns 0 at the end of the input or on a read
+ * error. Lines that are not packets, or too long to be, are counted in
+ * skipped.
+ */
+int
+packet_read(struct packet_reader *pr, struct packet *pkt)
+{
+	for (;;) {
+		char *line = pr->buf + pr->pos;
+		char *nl = memchr(line, '\n', pr->len - pr->pos);
+
+		if (nl == NULL && !pr->eof) {
+			size_t n;
+
+			if (pr->pos == 0 && pr->len == sizeof(pr->buf)) {
+				/* Drop an endless line up to its end. */
+				pr->len = 0;
+				pr->overlong = 1;
+			}
+			memmove(pr->buf, line, pr->len - pr->pos);
+			pr->len -= pr->pos;
+			pr->pos = 0;
+			n = fread(pr->buf + pr->len, 1,
+			    sizeof(pr->buf) - pr->len, pr->file);
+			if (n == 0)
+				pr->eof = 1;
+			pr->len += n;
+			continue;
+		}
+
+		if (nl == NULL) {
+			if (pr->pos == pr->len)
+				return 0;
+			nl = pr->buf + pr->len;
+		}
+		pr->pos = nl - pr->buf + (nl < pr->buf + pr->len);
+
+		++pr->lines;
+		if (pr->overlong) {
+			pr->overlong = 0;
+			++pr->skipped;
+		} else if (nl > line) {
+			if (parse_line(line, nl, pkt))
+				return 1;
+			++pr->skipped;
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef PACKETS_H
+#define PACKETS_H
+
+/*
+ * Streaming reader for the packet lists of
+ *
+ *	ffprobe -show_packets -show_entries packet=pts_time,dts_time,size \
+ *	    -of csv=p=0
+ *
+ * Lines are parsed where they lie in the read buffer. Times are in
+ * whole microseconds, kept in doubles so they stay exact for any
+ * length of video.
+ */
+#define PACKET_BUFSIZE 65536
+
+struct packet {
+	double pts, dts;
+	int has_pts, has_dts;
+	double time;		/* pts, or dts when there is none */
+	long size;
+};
+
+struct packet_reader {
+	FILE *file;
+	char buf[PACKET_BUFSIZE];
+	size_t pos, len;
+	int eof, overlong;
+	long lines, skipped;
+};
+
+void packet_init(struct packet_reader *, FILE *);
+int packet_read(struct packet_reader *, struct packet *);
+
+#endif
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <netpbm/pam.h>
+
+#include "rawpnm.h"
+
+/*
+ * Set up raw reading for an image whose header was read with
+ * pnm_readpaminit(). Returns 0 when the raster is not raw 8-bit data
+ * and the caller has to use libnetpbm after all.
+ */
+int
+rawpnm_open(struct rawpnm *rp, const struct pam *pam)
+{
+	struct stat st;
+	long pos;
+
+	if (pam->format != RPPM_FORMAT && pam->format != RPGM_FORMAT &&
+	    pam->format != PAM_FORMAT)
+		return 0;
+
+	if (pam->maxval > 255)
+		return 0;
+
+	rp->file = pam->file;
+	rp->width = pam->width;
+	rp->height = pam->height;
+	rp->depth = pam->depth;
+	rp->rowbytes = (size_t)pam->width * pam->depth;
+	rp->buf = NULL;
+	rp->map = rp->next = NULL;
+	rp->maplen = 0;
+
+	pos = ftell(rp->file);
+	if (pos != -1 && fstat(fileno(rp->file), &st) == 0 &&
+	    S_ISREG(st.st_mode) &&
+	    (size_t)st.st_size >= pos + rp->rowbytes * rp->height) {
+		void *map;
+
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+		    fileno(rp->file), 0);
+		if (map != MAP_FAILED) {
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			rp->map = map;
+			rp->maplen = st.st_size;
+			rp->next = rp->map + pos;
+
+			return 1;
+		}
+	}
+
+	rp->buf = malloc(rp->rowbytes > 0 ? rp->rowbytes : 1);
+	if (rp->buf == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	return 1;
+}
+
+/*
+ * Return the next row of packed samples. The row stays valid until
+ * the next call.
+ */
+const unsigned char *
+rawpnm_readrow(struct rawpnm *rp)
+{
+	const unsigned char *row;
+
+	if (rp->map != NULL) {
+		row = rp->next;
+		rp->next += rp->rowbytes;
+
+		return row;
+	}
+
+	if (fread(rp->buf, 1, rp->rowbytes, rp->file) != rp->rowbytes) {
+		fprintf(stderr, "premature end of input.\n");
+		exit(1);
+	}
+
+	return rp->buf;
+}
+
+void
+rawpnm_close(struct rawpnm *rp)
+{
+	if (rp->map != NULL)
+		munmap(rp->map, rp->maplen);
+	free(rp->buf);
+}
+
+/*
+ * Write a row of PBM_BLACK/PBM_WHITE bits packed 8 per byte; packed
+ * needs room for (width + 7) / 8 bytes.
+ */
+void
+rawpbm_writerow(FILE *f, const bit *row, int width, unsigned char *packed)
+{
+	int x, n = 0;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		packed[n++] = (row[x + 0] << 7) | (row[x + 1] << 6) |
+		    (row[x + 2] << 5) | (row[x + 3] << 4) |
+		    (row[x + 4] << 3) | (row[x + 5] << 2) |
+		    (row[x + 6] << 1) | (row[x + 7] << 0);
+	}
+
+	if (x < width) {
+		unsigned char byte = 0;
+		int shift = 7;
+
+		for (; x < width; ++x)
+			byte |= row[x] << shift--;
+		packed[n++] = byte;
+	}
+
+	rawpnm_writerow(f, packed, n);
+}
+
+void
+rawpnm_writerow(FILE *f, const unsigned char *row, size_t len)
+{
+	if (len > 0 && fwrite(row, len, 1, f) != 1) {
+		perror("fwrite");
+		exit(1);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef RAWPNM_H
+#define RAWPNM_H
+
+/*
+ * Fast path for raw 8-bit netpbm images. libnetpbm still parses the
+ * header, but the raster is read straight into packed bytes (or
+ * mapped when the input is a regular file) instead of being expanded
+ * into tuples.
+ */
+struct rawpnm {
+	FILE *file;
+	int width, height, depth;
+	size_t rowbytes;
+	unsigned char *buf;
+	unsigned char *map, *next;
+	size_t maplen;
+};
+
+int rawpnm_open(struct rawpnm *, const struct pam *);
+const unsigned char *rawpnm_readrow(struct rawpnm *);
+void rawpnm_close(struct rawpnm *);
+
+void rawpbm_writerow(FILE *, const bit *, int, unsigned char *);
+void rawpnm_writerow(FILE *, const unsigned char *, size_t);
+
+#endif
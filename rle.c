@@ -2,146 +2,116 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "common.h"
+#include "stats.h"
+
 #define MARKER 0xFF
 
 typedef unsigned char uchar;
 
-size_t
-compress(uchar *in, uchar *out, size_t len)
+/*
+ * A run of up to 255 bytes, or a marker byte, becomes marker, length,
+ * byte; anything else is copied.
+ */
+static void
+compress(struct reader *in, struct writer *out)
 {
-	size_t i = 0, olen = 0;
-
-	while (i < len) {
-		uchar ch = in[i], reps = 1;
-
-		while (i + reps < len && reps < 255 && ch == in[i + reps])
+	unsigned long runs = 0, literals = 0;
+	int ch, next;
+
+	while ((ch = READ_BYTE(in)) != EOF) {
+		int reps = 1;
+
+		while (reps < 255) {
+			if ((next = READ_BYTE(in)) != ch) {
+				if (next != EOF)
+					UNREAD_BYTE(in);
+				break;
+			}
 			++reps;
+		}
 
 		if (reps > 1 || ch == MARKER) {
-			out[olen++] = MARKER;
-			out[olen++] = reps;
-			out[olen++] = ch;
-			i += reps;
+			WRITE_BYTE(out, MARKER);
+			WRITE_BYTE(out, reps);
+			WRITE_BYTE(out, ch);
+			++runs;
 		} else {
-			out[olen++] = ch;
-			++i;
+			WRITE_BYTE(out, ch);
+			++literals;
 		}
 	}
 
-	return olen;
+	stats_count("runs", runs);
+	stats_count("literals", literals);
 }
 
-size_t
-decompress(uchar *in, uchar *out, size_t len)
+static int
+decompress(struct reader *in, struct writer *out)
 {
-	size_t i = 0, olen = 0;
-
-	while (i < len) {
-		uchar ch = in[i];
-
-		if (ch == MARKER) {
-			uchar reps = in[i + 1];
-			uchar j;
-
-			ch = in[i + 2];
-			for (j = 0; j < reps; ++j)
-				out[olen++] = ch;
-
-			i += 3;
-		} else {
-			out[olen++] = ch;
-			++i;
+	unsigned long runs = 0, literals = 0;
+	uchar run[255];
+	int ch, reps;
+
+	while ((ch = READ_BYTE(in)) != EOF) {
+		if (ch != MARKER) {
+			WRITE_BYTE(out, ch);
+			++literals;
+			continue;
 		}
-	}
-
-	return olen;
-}
-
-void
-die(const char *msg)
-{
-	perror(msg);
-	exit(1);
-}
-
-FILE *
-xfopen(const char *filename, const char *mode)
-{
-	FILE *fp;
 
-	fp = fopen(filename, mode);
-	if (fp == NULL)
-		die("fopen");
-
-	return fp;
-}
-
-long
-get_file_size(const char *filename)
-{
-	FILE *fp;
-	long size;
-
-	fp = xfopen(filename, "rb");
-	fseek(fp, 0, SEEK_END);
-	size = ftell(fp);
-	fclose(fp);
-
-	return size;
-}
-
-void *
-xmalloc(size_t size)
-{
-	void *ptr;
+		if ((reps = READ_BYTE(in)) == EOF ||
+		    (ch = READ_BYTE(in)) == EOF)
+			return -1;
+		memset(run, ch, reps);
+		writer_write(out, run, reps);
+		++runs;
+	}
 
-	ptr = malloc(size);
-	if (ptr == NULL)
-		die("malloc");
+	stats_count("runs", runs);
+	stats_count("literals", literals);
 
-	return ptr;
+	return 0;
 }
 
 int
 main(int argc, char **argv)
 {
-	FILE *in, *out;
-	uchar *inbuf, *outbuf;
-	long fsize;
-	size_t len, nread;
+	struct reader in;
+	struct writer out;
+	unsigned long clock;
+	int error;
 
 	if (argc != 4 || argv[1][0] == '\0') {
 		fprintf(stderr, "args?\n");
 		return 1;
 	}
 
-	fsize = get_file_size(argv[2]);
-	in = xfopen(argv[2], "rb");
-	out = xfopen(argv[3], "wb");
-	inbuf = xmalloc(fsize);
+	stats_init("rle", 0);
+	clock = stats_clock();
 
-	if (argv[1][0] == 'c') {
-		/* each byte can expand to 3 bytes: 0xFF, 0x01, 0xFF */
-		outbuf = xmalloc(fsize * 3);
+	if (reader_open(&in, argv[2]) != 0)
+		die("%s:", argv[2]);
+	if (writer_open(&out, argv[3]) != 0)
+		die("%s:", argv[3]);
+	stats_lap("open", &clock);
 
-		while ((nread = fread(inbuf, 1, fsize, in)) > 0) {
-			len = compress(inbuf, outbuf, nread);
-			fwrite(outbuf, len, 1, out);
-		}
+	if (argv[1][0] == 'c') {
+		compress(&in, &out);
+		stats_lap("compress", &clock);
 	} else {
-		/* 3 bytes can expand to 255 */
-		outbuf = xmalloc(fsize / 3 * 255);
-
-		while ((nread = fread(inbuf, 1, fsize, in)) > 0) {
-			len = decompress(inbuf, outbuf, nread);
-			fwrite(outbuf, len, 1, out);
-		}
+		if (decompress(&in, &out) != 0)
+			die("%s: truncated run.", argv[2]);
+		stats_lap("decompress", &clock);
 	}
 
-	free(inbuf);
-	free(outbuf);
-	fclose(in);
-	fclose(out);
+	if ((error = reader_close(&in)) != 0)
+		die("%s: %s", argv[2], strerror(error));
+	if ((error = writer_close(&out)) != 0)
+		die("%s: %s", argv[3], strerror(error));
+	stats_lap("close", &clock);
+	stats_count("bytes_read", in.nread);
+	stats_count("bytes_written", out.nwritten);
 
 	return 0;
 }
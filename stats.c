@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define MAXSTATS 32
+
+struct entry {
+	const char *name;
+	unsigned long value;
+};
+
+struct stats {
+	const char *tool;
+	const char *json;
+	unsigned long start_ticks;
+	double start_ns;
+	struct entry phases[MAXSTATS];
+	struct entry counters[MAXSTATS];
+	int nphases, ncounters;
+};
+
+int stats_enabled;
+static struct stats stats;
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long
+ticks(void)
+{
+#if defined(__GNUC__) && defined(__x86_64__)
+	return __builtin_ia32_rdtsc();
+#else
+	return now_ns();
+#endif
+}
+
+/*
+ * Find an entry by name, adding it if there is room. The names are
+ * usually the same string constant, so compare pointers first.
+ */
+static struct entry *
+find(struct entry *list, int *n, const char *name)
+{
+	int i;
+
+	for (i = 0; i < *n; ++i)
+		if (list[i].name == name || strcmp(list[i].name, name) == 0)
+			return &list[i];
+	if (*n == MAXSTATS)
+		return NULL;
+
+	list[*n].name = name;
+	list[*n].value = 0;
+
+	return &list[(*n)++];
+}
+
+static void
+report_text(FILE *fp, double wall, double ns_per_tick)
+{
+	int i;
+
+	fprintf(fp, "%s:\n", stats.tool);
+	for (i = 0; i < stats.nphases; ++i) {
+		double s = stats.phases[i].value * ns_per_tick / 1e9;
+
+		fprintf(fp, "%-14s %10.3fs %5.1f%%\n", stats.phases[i].name, s,
+		    wall > 0 ? s * 100 / wall : 0);
+	}
+	fprintf(fp, "%-14s %10.3fs\n", "total", wall);
+	for (i = 0; i < stats.ncounters; ++i)
+		fprintf(fp, "%-14s %11lu %12.0f/s\n", stats.counters[i].name,
+		    stats.counters[i].value,
+		    wall > 0 ? stats.counters[i].value / wall : 0);
+}
+
+static void
+report_json(FILE *fp, double wall, double ns_per_tick)
+{
+	int i;
+
+	fprintf(fp, "{\"tool\": \"%s\", \"wall_s\": %.6f, \"phases\": {",
+	    stats.tool, wall);
+	for (i = 0; i < stats.nphases; ++i)
+		fprintf(fp, "%s\"%s\": %.6f", i > 0 ? ", " : "",
+		    stats.phases[i].name,
+		    stats.phases[i].value * ns_per_tick / 1e9);
+	fprintf(fp, "}, \"counters\": {");
+	for (i = 0; i < stats.ncounters; ++i)
+		fprintf(fp, "%s\"%s\": %lu", i > 0 ? ", " : "",
+		    stats.counters[i].name, stats.counters[i].value);
+	fprintf(fp, "}}\n");
+}
+
+/*
+ * Ticks are converted with their rate over the whole run.
+ */
+static void
+report(void)
+{
+	unsigned long t = ticks();
+	double wall = (now_ns() - stats.start_ns) / 1e9;
+	double ns_per_tick = t > stats.start_ticks ?
+	    wall * 1e9 / (t - stats.start_ticks) : 1;
+	FILE *fp;
+
+	if (stats.json == NULL) {
+		report_text(stderr, wall, ns_per_tick);
+		return;
+	}
+
+	if ((fp = fopen(stats.json, "w")) == NULL) {
+		perror(stats.json);
+		return;
+	}
+	report_json(fp, wall, ns_per_tick);
+	if (fclose(fp) != 0)
+		perror(stats.json);
+}
+
+/*
+ * Turn stats on for -v or MISC_STATS, the report is made at exit.
+ */
+void
+stats_init(const char *tool, int verbose)
+{
+	const char *env = getenv("MISC_STATS");
+
+	if (!verbose && (env == NULL || *env == '\0'))
+		return;
+
+	stats.tool = tool;
+	if (!verbose && strcmp(env, "1") != 0)
+		stats.json = env;
+	stats.start_ns = now_ns();
+	stats.start_ticks = ticks();
+	stats_enabled = 1;
+	atexit(report);
+}
+
+unsigned long
+stats_clock(void)
+{
+	return stats_enabled ? ticks() : 0;
+}
+
+/*
+ * Add the time since *clock to a phase and restart the clock.
+ */
+void
+stats_lap(const char *phase, unsigned long *clock)
+{
+	struct entry *s;
+	unsigned long t;
+
+	if (!stats_enabled)
+		return;
+
+	t = ticks();
+	if ((s = find(stats.phases, &stats.nphases, phase)) != NULL)
+		s->value += t - *clock;
+	*clock = t;
+}
+
+void
+stats_count(const char *counter, unsigned long n)
+{
+	struct entry *s;
+
+	if (stats_enabled &&
+	    (s = find(stats.counters, &stats.ncounters, counter)) != NULL)
+		s->value += n;
+}
@@ -0,0 +1,24 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Where the time of a tool goes. With -v, for tools that have it, or
+ * MISC_STATS set to 1 a report of the time per phase and the counters
+ * goes to stderr at exit; MISC_STATS set to anything else is taken as
+ * a file to write it to as json.
+ *
+ * Time is counted in cpu ticks where there is a cheap counter for them
+ * and converted to seconds for the report. When stats are off a lap
+ * is a test of stats_enabled; count in local variables in hot loops
+ * and hand the totals to stats_count() at the end.
+ *
+ * Only call these from one thread.
+ */
+extern int stats_enabled;
+
+void stats_init(const char *, int);
+unsigned long stats_clock(void);
+void stats_lap(const char *, unsigned long *);
+void stats_count(const char *, unsigned long);
+
+#endif
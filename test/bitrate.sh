@@ -0,0 +1,59 @@
+#! /bin/sh
+#
+# Run bitrate over the saved ffprobe packet lists in test/bitrate and
+# compare its histogram and summary with the expected ones. NAME.csv
+# is run with the defaults, NAME-RATEk.csv checks maxrate RATE with a
+# 4000k buffer and 100k bins on the packets of NAME.csv.
+#
+
+bitrate="${BITRATE:-./bitrate}"
+dir="${DIR:-test/bitrate}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+[ -x "$bitrate" ] || die "$bitrate not found, run make first."
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+failed=0
+
+check() {
+    name=$1
+    shift
+    if "$bitrate" -o "$tmpdir/hist" "$@" > "$tmpdir/stats" 2> /dev/null &&
+        cmp -s "$tmpdir/hist" "$dir/$name.hist" &&
+        cmp -s "$tmpdir/stats" "$dir/$name.stats"; then
+        printf "ok   %s\n" "$name"
+    else
+        printf "FAIL %s\n" "$name"
+        failed=1
+    fi
+}
+
+for expected in "$dir"/*.stats; do
+    name=$(basename "$expected" .stats)
+    case "$name" in
+    *-*k)
+        rate=${name##*-}
+        check "$name" -m "${rate%k}" -b 4000 -w 100 "$dir/${name%-*}.csv"
+        ;;
+    *)
+        check "$name" "$dir/$name.csv"
+        check "$name" < "$dir/$name.csv"
+        ;;
+    esac
+done
+
+# Lines longer than the read buffer are skipped, not split.
+awk 'BEGIN { printf "0.000000,0.000000,"; for (i = 0; i < 70000; i++)
+    printf "9"; printf "\n0.000000,0.000000,1000\n" }' > "$tmpdir/long.csv"
+"$bitrate" "$tmpdir/long.csv" 2> /dev/null | grep -q "^size  *1000 bytes" ||
+    { printf "FAIL long line\n"; failed=1; }
+
+[ "$failed" -eq 0 ] || die "bitrate tests failed."
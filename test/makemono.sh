@@ -0,0 +1,73 @@
+#! /bin/sh
+#
+# Run makemono over colors that are split by the end of its read buffer
+# and compare the converted text with what it makes of the same file
+# read at once, and convert a directory into an outdir inside it.
+#
+
+makemono="${MAKEMONO:-./makemono}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+[ -x "$makemono" ] || die "$makemono not found, run make first."
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+# The size of the reader buffer, READER_BUFSIZE in common.h.
+bufsize=262144
+
+failed=0
+
+# Put each color so it starts a few bytes before the buffer ends, the
+# conversion of the file is known to find it when it is mapped whole.
+split() {
+    name=$1 color=$2 expected=$3
+
+    for before in 1 5 40 100; do
+        head -c $((bufsize - before)) /dev/zero | tr '\0' x > "$tmpdir/in"
+        printf "%s;\n" "$color" >> "$tmpdir/in"
+
+        "$makemono" < "$tmpdir/in" > "$tmpdir/whole"
+        cat "$tmpdir/in" | "$makemono" > "$tmpdir/piped"
+        if ! tail -c +$((bufsize - before + 1)) "$tmpdir/whole" |
+            grep -qxF "$expected;" ||
+            ! cmp -s "$tmpdir/whole" "$tmpdir/piped"; then
+            printf "FAIL %s at %d\n" "$name" "$before"
+            failed=1
+            return
+        fi
+    done
+    printf "ok   %s\n" "$name"
+}
+
+# Longer than the 64 bytes makemono used to keep for the next read.
+pad=$(printf "%32s" "")
+
+split hex "#ff0000" "#4c4c4c"
+split rgba "rgba(255,${pad}0,${pad}0,${pad}0.50000000000000)" \
+    "rgba(76, 76, 76, 0.50000000000000)"
+split hsla "hsla(${pad}0deg, 100%,${pad}50%,${pad}0.5${pad})" \
+    "rgba(76, 76, 76, 0.5)"
+split x11 "rgb:ffff/0000/0000" "rgb:4c4c/4c4c/4c4c"
+
+# The outdir is made before the walk and must not be walked itself.
+mkdir -p "$tmpdir/tree/sub"
+printf "#ff0000;\n" > "$tmpdir/tree/a.css"
+printf "#ff0000;\n" > "$tmpdir/tree/sub/b.css"
+if "$makemono" -o "$tmpdir/tree/out" "$tmpdir/tree" 2> /dev/null &&
+    [ ! -e "$tmpdir/tree/out/out" ] &&
+    grep -qxF "#4c4c4c;" "$tmpdir/tree/out/a.css" &&
+    grep -qxF "#4c4c4c;" "$tmpdir/tree/out/sub/b.css"; then
+    printf "ok   outdir in input\n"
+else
+    printf "FAIL outdir in input\n"
+    failed=1
+fi
+
+[ "$failed" -eq 0 ] || die "makemono tests failed."
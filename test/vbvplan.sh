@@ -0,0 +1,52 @@
+#! /bin/sh
+#
+# Run vbvplan over packet lists and compare its report with the
+# expected NAME.out in test/vbvplan. The packets are read from NAME.csv
+# there or else from the one bitrate is tested on, with the options in
+# NAME.args if there is one.
+#
+
+vbvplan="${VBVPLAN:-./vbvplan}"
+dir="${DIR:-test/vbvplan}"
+packets="${PACKETS:-test/bitrate}"
+
+set -eu
+
+die() {
+    printf "%s\n" "$*" >&2
+    exit 1
+}
+
+[ -x "$vbvplan" ] || die "$vbvplan not found, run make first."
+
+tmpdir=$(mktemp -d)
+trap 'rm -rf "$tmpdir"' EXIT INT TERM
+
+failed=0
+
+for expected in "$dir"/*.out; do
+    name=$(basename "$expected" .out)
+    csv="$dir/$name.csv"
+    [ -f "$csv" ] || csv="$packets/$name.csv"
+    args=""
+    [ -f "$dir/$name.args" ] && args=$(cat "$dir/$name.args")
+
+    # shellcheck disable=SC2086
+    if "$vbvplan" $args "$csv" > "$tmpdir/out" 2> /dev/null &&
+        cmp -s "$tmpdir/out" "$expected"; then
+        printf "ok   %s\n" "$name"
+    else
+        printf "FAIL %s\n" "$name"
+        failed=1
+    fi
+done
+
+# With -c the exit status tells whether the buffer ran dry.
+"$vbvplan" -c "$packets/cbr.csv" > /dev/null 2>&1 ||
+    { printf "FAIL check cbr\n"; failed=1; }
+if "$vbvplan" -c "$packets/vbr.csv" > /dev/null 2>&1; then
+    printf "FAIL check vbr\n"
+    failed=1
+fi
+
+[ "$failed" -eq 0 ] || die "vbvplan tests failed."
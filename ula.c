@@ -5,17 +5,64 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <arpa/inet.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
 
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 25)
+#include <sys/random.h>
+#define HAVE_GETRANDOM
+#endif
+
 #define RANDOM_SOURCE "/dev/urandom"
 
+/*
+ * Random bytes come from ChaCha20 keyed from the system, RANDOM_BLOCKS
+ * blocks at a time. The first KEYSIZE bytes of every batch rekey it
+ * and are never handed out, so earlier output can not be recovered
+ * from the state.
+ */
+#define RANDOM_BLOCKS 16
+#define KEYSIZE 40
+
+/*
+ * Pools with at most BITMAP_BITS bits of subnet number keep allocated
+ * subnets in a bitmap, bigger ones in a hash set.
+ */
+#define BITMAP_BITS 24
+
 typedef unsigned char uchar;
 typedef unsigned int uint;
+typedef unsigned long ulong;
 
 typedef uint ipv4_address;
 
+/*
+ * Subnets of length len in the parent network base/parentlen, numbered
+ * by the span bits in between.
+ */
+struct pool {
+	int family, addrbits;
+	uchar base[16];
+	int parentlen, len, span;
+	ulong nsubnets, nused;
+	uchar *bitmap;
+	ulong *set;
+	ulong setsize;
+};
+
+static uint chacha_state[16];
+static uchar random_buf[RANDOM_BLOCKS * 64];
+static uchar *random_pos = random_buf + sizeof(random_buf);
+
+static char outbuf[65536];
+static size_t outlen;
+
 /*
  * Read nbytes from a file into a destination buf and be persistent
  * about it.
@@ -44,34 +91,162 @@ blocking_read(const char *filename, void *dst, ssize_t size)
 }
 
 /*
- * Get nbytes of random data from the system.
+ * Get nbytes of random data from the system, with getrandom when there
+ * is one and else from RANDOM_SOURCE.
  */
 static void
-system_random(void *dst_ptr, size_t size)
+system_random(void *dst, size_t size)
 {
-	static uchar buf[128], *pos;
-	uchar *buf_end, *dst = dst_ptr;
-
-	pos = buf_end = buf + sizeof(buf);
+#ifdef HAVE_GETRANDOM
+	uchar *p = dst;
+	ssize_t n;
 
 	while (size > 0) {
-		if (pos >= buf_end) {
-			blocking_read(RANDOM_SOURCE, buf, sizeof(buf));
-			pos = buf;
+		if ((n = getrandom(p, size, 0)) == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOSYS)
+				break;
+			perror("getrandom");
+			exit(1);
 		}
+		p += n;
+		size -= n;
+	}
+	if (size == 0)
+		return;
+	dst = p;
+#endif
+	blocking_read(RANDOM_SOURCE, dst, size);
+}
+
+static uint
+load32(const uchar *p)
+{
+	return p[0] | (uint)p[1] << 8 | (uint)p[2] << 16 | (uint)p[3] << 24;
+}
+
+static void
+store32(uchar *p, uint v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint
+rotl(uint v, int n)
+{
+	return v << n | v >> (32 - n);
+}
+
+static void
+quarter_round(uint *x, int a, int b, int c, int d)
+{
+	x[a] += x[b];
+	x[d] = rotl(x[d] ^ x[a], 16);
+	x[c] += x[d];
+	x[b] = rotl(x[b] ^ x[c], 12);
+	x[a] += x[b];
+	x[d] = rotl(x[d] ^ x[a], 8);
+	x[c] += x[d];
+	x[b] = rotl(x[b] ^ x[c], 7);
+}
+
+/*
+ * One ChaCha20 block of the state into out, then step the counter.
+ */
+static void
+chacha_block(uchar *out)
+{
+	uint x[16];
+	int i;
+
+	memcpy(x, chacha_state, sizeof(x));
+	for (i = 0; i < 10; ++i) {
+		quarter_round(x, 0, 4, 8, 12);
+		quarter_round(x, 1, 5, 9, 13);
+		quarter_round(x, 2, 6, 10, 14);
+		quarter_round(x, 3, 7, 11, 15);
+		quarter_round(x, 0, 5, 10, 15);
+		quarter_round(x, 1, 6, 11, 12);
+		quarter_round(x, 2, 7, 8, 13);
+		quarter_round(x, 3, 4, 9, 14);
+	}
+	for (i = 0; i < 16; ++i)
+		store32(out + 4 * i, x[i] + chacha_state[i]);
+
+	if (++chacha_state[12] == 0)
+		++chacha_state[13];
+}
+
+/*
+ * Key with 32 bytes of key and 8 of nonce, counting from zero.
+ */
+static void
+chacha_key(const uchar *key)
+{
+	int i;
+
+	chacha_state[0] = 0x61707865;
+	chacha_state[1] = 0x3320646e;
+	chacha_state[2] = 0x79622d32;
+	chacha_state[3] = 0x6b206574;
+	for (i = 0; i < 8; ++i)
+		chacha_state[4 + i] = load32(key + 4 * i);
+	chacha_state[12] = 0;
+	chacha_state[13] = 0;
+	chacha_state[14] = load32(key + 32);
+	chacha_state[15] = load32(key + 36);
+}
+
+static void
+refill_random(void)
+{
+	static int seeded;
+	int i;
+
+	if (!seeded) {
+		uchar seed[KEYSIZE];
+
+		system_random(seed, sizeof(seed));
+		chacha_key(seed);
+		memset(seed, 0, sizeof(seed));
+		seeded = 1;
+	}
+
+	for (i = 0; i < RANDOM_BLOCKS; ++i)
+		chacha_block(random_buf + 64 * i);
+
+	chacha_key(random_buf);
+	memset(random_buf, 0, KEYSIZE);
+	random_pos = random_buf + KEYSIZE;
+}
 
-		if (pos + size <= buf_end) {
-			memcpy(dst, pos, size);
-			pos += size;
-			size = 0;
-		} else {
-			size_t len = buf_end - pos;
-
-			memcpy(dst, pos, len);
-			dst += len;
-			pos += len;
-			size -= len;
+/*
+ * Get nbytes of random data.
+ */
+static void
+random_bytes(void *dst_ptr, size_t size)
+{
+	uchar *dst = dst_ptr;
+
+	while (size > 0) {
+		size_t len = random_buf + sizeof(random_buf) - random_pos;
+
+		if (len == 0) {
+			refill_random();
+			continue;
 		}
+		if (len > size)
+			len = size;
+
+		memcpy(dst, random_pos, len);
+		memset(random_pos, 0, len);
+		dst += len;
+		random_pos += len;
+		size -= len;
 	}
 }
 
@@ -93,7 +268,7 @@ random_bits(int nbits)
 	if (nbits - nbytes * 8 > 0)
 		++nbytes;
 
-	system_random(&ret, nbytes);
+	random_bytes(&ret, nbytes);
 
 	/* Drop the extra bits from rounding. */
 	nbits -= nbytes * 8;
@@ -103,6 +278,59 @@ random_bits(int nbits)
 	return ret;
 }
 
+/*
+ * Addresses are formatted into outbuf, which is written out when it
+ * gets full and at exit.
+ */
+static void
+flush_output(void)
+{
+	if (fwrite(outbuf, 1, outlen, stdout) != outlen ||
+	    fflush(stdout) != 0) {
+		perror("write");
+		exit(1);
+	}
+	outlen = 0;
+}
+
+static char *
+output_space(size_t len)
+{
+	if (outlen + len > sizeof(outbuf))
+		flush_output();
+
+	return outbuf + outlen;
+}
+
+static char *
+put_decimal(char *p, uint n)
+{
+	if (n >= 100)
+		*p++ = '0' + n / 100;
+	if (n >= 10)
+		*p++ = '0' + n / 10 % 10;
+	*p++ = '0' + n % 10;
+
+	return p;
+}
+
+/*
+ * Hex without leading zeros but at least mindigits digits.
+ */
+static char *
+put_hex(char *p, uint n, int mindigits)
+{
+	static const char hex[] = "0123456789abcdef";
+	int shift = 12;
+
+	while (shift > 0 && shift >= 4 * mindigits && (n >> shift) == 0)
+		shift -= 4;
+	for (; shift >= 0; shift -= 4)
+		*p++ = hex[n >> shift & 15];
+
+	return p;
+}
+
 static void
 do_ipv4(void)
 {
@@ -111,48 +339,408 @@ do_ipv4(void)
 	ipv4_address addr;
 	int shift;
 	int pick;
+	char *p, *start;
 
 	pick = abs((int)random_bits(2) - 1);
 	addr = net[pick];
 
 	addr += random_bits(32 - bits[pick]);
-	for (shift = 24; shift > 0; shift -= 8)
-		printf("%d.", (addr >> shift) & 0xff);
-	printf("%d/%d\n", addr & 0xff, bits[pick]);
+
+	p = start = output_space(sizeof("255.255.255.255/32\n"));
+	for (shift = 24; shift > 0; shift -= 8) {
+		p = put_decimal(p, (addr >> shift) & 0xff);
+		*p++ = '.';
+	}
+	p = put_decimal(p, addr & 0xff);
+	*p++ = '/';
+	p = put_decimal(p, bits[pick]);
+	*p++ = '\n';
+	outlen += p - start;
 }
 
 static void
 do_ipv6(void)
 {
+	char *p, *start;
 	int i;
 
-	printf("fd%02x", random_bits(8));
-	for (i = 0; i < 7; ++i)
-		printf(":%x", random_bits(16));
-	printf("/64\n");
+	p = start = output_space(sizeof("fdxx:xxxx:xxxx:xxxx:xxxx:xxxx:"
+	    "xxxx:xxxx/64\n"));
+	*p++ = 'f';
+	*p++ = 'd';
+	p = put_hex(p, random_bits(8), 2);
+	for (i = 0; i < 7; ++i) {
+		*p++ = ':';
+		p = put_hex(p, random_bits(16), 1);
+	}
+	memcpy(p, "/64\n", 4);
+	p += 4;
+	outlen += p - start;
+}
+
+static void *
+xcalloc(size_t n, size_t size)
+{
+	void *ptr;
+
+	ptr = calloc(n, size);
+	if (ptr == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+
+	return ptr;
+}
+
+/*
+ * Parse addr/len into a 16 byte buffer, returns the family or 0.
+ */
+static int
+parse_prefix(const char *str, uchar *addr, int *len)
+{
+	char buf[INET6_ADDRSTRLEN];
+	const char *slash;
+	char *end;
+	int family;
+
+	if ((slash = strchr(str, '/')) == NULL ||
+	    (size_t)(slash - str) >= sizeof(buf))
+		return 0;
+	memcpy(buf, str, slash - str);
+	buf[slash - str] = '\0';
+
+	memset(addr, 0, 16);
+	family = strchr(buf, ':') != NULL ? AF_INET6 : AF_INET;
+	if (inet_pton(family, buf, addr) != 1)
+		return 0;
+
+	*len = strtol(slash + 1, &end, 10);
+	if (end == slash + 1 || (*end != '\0' && *end != '\n') ||
+	    *len < 0 || *len > (family == AF_INET ? 32 : 128))
+		return 0;
+
+	return family;
+}
+
+static int
+get_bit(const uchar *addr, int bit)
+{
+	return addr[bit / 8] >> (7 - bit % 8) & 1;
+}
+
+static void
+set_bit(uchar *addr, int bit, int v)
+{
+	if (v)
+		addr[bit / 8] |= 0x80 >> bit % 8;
+	else
+		addr[bit / 8] &= ~(0x80 >> bit % 8);
+}
+
+static void
+pool_init(struct pool *pool, const char *parent, int len)
+{
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->family = parse_prefix(parent, pool->base, &pool->parentlen);
+	if (pool->family == 0) {
+		fprintf(stderr, "%s: not a network address/length.\n",
+		    parent);
+		exit(1);
+	}
+	pool->addrbits = pool->family == AF_INET ? 32 : 128;
+
+	for (i = pool->parentlen; i < pool->addrbits; ++i)
+		if (get_bit(pool->base, i)) {
+			fprintf(stderr, "%s: host bits are set.\n", parent);
+			exit(1);
+		}
+
+	if (len <= pool->parentlen || len > pool->addrbits) {
+		fprintf(stderr, "/%d subnets do not fit in %s.\n", len,
+		    parent);
+		exit(1);
+	}
+	pool->len = len;
+	pool->span = len - pool->parentlen;
+	if (pool->span >= (int)sizeof(ulong) * CHAR_BIT) {
+		fprintf(stderr, "%s has too many /%d subnets.\n", parent,
+		    len);
+		exit(1);
+	}
+	pool->nsubnets = 1UL << pool->span;
+
+	if (pool->span <= BITMAP_BITS)
+		pool->bitmap = xcalloc(pool->nsubnets / 8 + 1, 1);
+	else {
+		pool->setsize = 1024;
+		pool->set = xcalloc(pool->setsize, sizeof(*pool->set));
+	}
+}
+
+/*
+ * Slots in the set hold the subnet number plus one, zero is free.
+ */
+static ulong *
+set_slot(ulong *set, ulong setsize, ulong n)
+{
+	ulong i = (n * 2654435761UL ^ n >> 16) & (setsize - 1);
+
+	while (set[i] != 0 && set[i] != n + 1)
+		i = (i + 1) & (setsize - 1);
+
+	return &set[i];
+}
+
+static void
+set_grow(struct pool *pool)
+{
+	ulong *old = pool->set, oldsize = pool->setsize, i;
+
+	pool->setsize *= 2;
+	pool->set = xcalloc(pool->setsize, sizeof(*pool->set));
+	for (i = 0; i < oldsize; ++i)
+		if (old[i] != 0)
+			*set_slot(pool->set, pool->setsize, old[i] - 1) =
+			    old[i];
+	free(old);
+}
+
+/*
+ * Mark subnet n as used, returns 0 if it already was.
+ */
+static int
+pool_take(struct pool *pool, ulong n)
+{
+	if (pool->bitmap != NULL) {
+		uchar *byte = &pool->bitmap[n / 8];
+		int mask = 1 << n % 8;
+
+		if (*byte & mask)
+			return 0;
+		*byte |= mask;
+	} else {
+		ulong *slot;
+
+		slot = set_slot(pool->set, pool->setsize, n);
+		if (*slot != 0)
+			return 0;
+		*slot = n + 1;
+		if (pool->nused + 1 > pool->setsize / 2)
+			set_grow(pool);
+	}
+
+	++pool->nused;
+	return 1;
+}
+
+static void
+pool_address(const struct pool *pool, ulong n, uchar *addr)
+{
+	int i;
+
+	memcpy(addr, pool->base, 16);
+	for (i = 0; i < pool->span; ++i)
+		set_bit(addr, pool->len - 1 - i, n >> i & 1);
+}
+
+/*
+ * Get the number of subnet addr/len in the pool, returns -1 if it is
+ * not one of them.
+ */
+static int
+pool_number(const struct pool *pool, const uchar *addr, int len,
+    ulong *n)
+{
+	int i;
+
+	if (len != pool->len)
+		return -1;
+	for (i = 0; i < pool->addrbits; ++i) {
+		int bit = get_bit(addr, i);
+
+		if (i < pool->parentlen && bit != get_bit(pool->base, i))
+			return -1;
+		if (i >= pool->len && bit)
+			return -1;
+	}
+
+	for (*n = 0, i = pool->parentlen; i < pool->len; ++i)
+		*n = *n << 1 | get_bit(addr, i);
+
+	return 0;
+}
+
+/*
+ * Mark the subnets of the pool listed in the state file as used, one
+ * per line. Other lines, like subnets of other pools, are kept but
+ * not looked at.
+ */
+static void
+pool_load(struct pool *pool, FILE *fp, const char *path)
+{
+	char line[128];
+	uchar addr[16];
+	ulong n;
+	int len;
+
+	rewind(fp);
+	while (fgets(line, sizeof(line), fp) != NULL)
+		if (parse_prefix(line, addr, &len) == pool->family &&
+		    pool_number(pool, addr, len, &n) == 0)
+			pool_take(pool, n);
+
+	if (ferror(fp) || fseek(fp, 0, SEEK_END) != 0) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static ulong
+random_subnet(const struct pool *pool)
+{
+	if (pool->span <= 32)
+		return random_bits(pool->span);
+
+	return (ulong)random_bits(pool->span - 32) << 16 << 16 |
+	    random_bits(32);
+}
+
+/*
+ * Print count subnets of the pool that are not in use yet, and append
+ * them to the state file if there is one. The state file is locked from
+ * loading it until the new subnets are in it, so runs at the same time
+ * hand out different ones, and subnets are only printed once they have
+ * been written to it.
+ */
+static void
+do_subnets(struct pool *pool, long count, const char *state)
+{
+	FILE *fp = NULL;
+	uchar addr[16];
+	char *p, *start;
+	size_t len = INET6_ADDRSTRLEN + sizeof("/128\n");
+
+	if (state != NULL) {
+		if ((fp = fopen(state, "a+")) == NULL ||
+		    flock(fileno(fp), LOCK_EX) != 0) {
+			perror(state);
+			exit(1);
+		}
+		pool_load(pool, fp, state);
+	}
+
+	if ((ulong)count > pool->nsubnets - pool->nused) {
+		fprintf(stderr, "only %lu free /%d subnets left.\n",
+		    pool->nsubnets - pool->nused, pool->len);
+		exit(1);
+	}
+
+	while (count-- > 0) {
+		ulong n;
+
+		while (!pool_take(pool, n = random_subnet(pool)))
+			continue;
+		pool_address(pool, n, addr);
+
+		if (fp != NULL && outlen + len > sizeof(outbuf) &&
+		    fflush(fp) != 0) {
+			perror(state);
+			exit(1);
+		}
+		p = start = output_space(len);
+		inet_ntop(pool->family, addr, p, INET6_ADDRSTRLEN);
+		p += strlen(p);
+		*p++ = '/';
+		p = put_decimal(p, pool->len);
+		*p++ = '\n';
+		if (fp != NULL &&
+		    fwrite(start, 1, p - start, fp) != (size_t)(p - start)) {
+			perror(state);
+			exit(1);
+		}
+		outlen += p - start;
+	}
+
+	/* Closing it unlocks it. */
+	if (fp != NULL &&
+	    (fflush(fp) != 0 || ferror(fp) || fclose(fp) != 0)) {
+		perror(state);
+		exit(1);
+	}
+}
+
+static void
+usage(void)
+{
+	puts("usage: ula [-4|-6] [-n count]\n"
+	    "       ula -p parent/len -l len [-n count] [-f statefile]");
+	exit(1);
 }
 
 int
 main(int argc, char **argv)
 {
-	if ((sizeof(ipv4_address) * 8) < 32) {
+	struct pool pool;
+	const char *parent = NULL, *state = NULL;
+	int ipv4 = 0, ipv6 = 0, len = 0;
+	long count = 1;
+	int ch;
+
+	if ((sizeof(ipv4_address) * 8) != 32) {
 		fprintf(stderr, "change ipv4_address in source.\n");
 		return 1;
 	}
 
-	if (argc > 1) {
-		if (strcmp(argv[1], "-4") == 0)
+	while ((ch = getopt(argc, argv, "46f:l:n:p:")) != -1) {
+		switch (ch) {
+		case '4':
+			ipv4 = 1;
+			break;
+		case '6':
+			ipv6 = 1;
+			break;
+		case 'f':
+			state = optarg;
+			break;
+		case 'l':
+			len = atoi(optarg);
+			break;
+		case 'n':
+			count = atol(optarg);
+			if (count < 1)
+				usage();
+			break;
+		case 'p':
+			parent = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || (ipv4 && ipv6))
+		usage();
+
+	if (parent != NULL || len != 0 || state != NULL) {
+		if (parent == NULL || len == 0 || ipv4 || ipv6)
+			usage();
+		pool_init(&pool, parent, len);
+		do_subnets(&pool, count, state);
+		flush_output();
+
+		return 0;
+	}
+	if (!ipv4 && !ipv6)
+		ipv4 = ipv6 = 1;
+
+	while (count-- > 0) {
+		if (ipv4)
 			do_ipv4();
-		else if (strcmp(argv[1], "-6") == 0)
+		if (ipv6)
 			do_ipv6();
-		else {
-			puts("usage: ula [-4|-6]");
-			return 1;
-		}
-	} else {
-		do_ipv4();
-		do_ipv6();
 	}
+	flush_output();
 
 	return 0;
 }
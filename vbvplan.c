@@ -0,0 +1,242 @@
+/*
+ * Plan the average bitrate of an encode from the packet list of an
+ * earlier one, see packets.h. The video buffer verifier of the decoder
+ * is simulated for the packets as they are and scaled up and down,
+ * all in one pass, to find the highest average bitrate at which the
+ * buffer never runs dry at the maximum rate.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include "packets.h"
+
+/* What tocd encodes for, a double speed cdrom. */
+#define MAXRATE_K 2000
+#define BUFSIZE_K (384 * 8)
+
+/*
+ * Packet sizes are scaled by 2^(k / STEPS) for k from -STEPS * OCTAVES
+ * to STEPS * OCTAVES, about 2% apart.
+ */
+#define STEPS 32
+#define OCTAVES 4
+#define NSCALES (2 * STEPS * OCTAVES + 1)
+#define AS_IS (STEPS * OCTAVES)
+
+/*
+ * The buffer fills at maxrate up to its size and each packet is taken
+ * out at its decode time, starting from a full buffer. It runs dry
+ * when a packet is bigger than what is in it.
+ *
+ * Bigger packets can only leave less in the buffer, so once scale k
+ * runs dry so do all scales above it and those are not simulated any
+ * further. The packets as they are always are, for the report.
+ */
+struct plan {
+	double maxrate, bufsize;
+	double scale[NSCALES];
+	double level[NSCALES];
+	int limit;
+	long underflows;
+	double first_underflow;
+	double lowest, lowest_time;
+	double start, last, bits;
+	long packets;
+};
+
+static void
+plan_init(struct plan *plan, int maxrate_k, int bufsize_k)
+{
+	int k;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->maxrate = maxrate_k * 1000.0;
+	plan->bufsize = bufsize_k * 1000.0;
+	for (k = 0; k < NSCALES; ++k) {
+		plan->scale[k] = pow(2, (double)(k - AS_IS) / STEPS);
+		plan->level[k] = plan->bufsize;
+	}
+	plan->limit = NSCALES;
+	plan->lowest = plan->bufsize;
+}
+
+static double
+refill(const struct plan *plan, double level, double fill)
+{
+	level += fill;
+
+	return level < plan->bufsize ? level : plan->bufsize;
+}
+
+/*
+ * Times are in microseconds.
+ */
+static void
+plan_packet(struct plan *plan, double time, long size)
+{
+	double fill = 0, bits = size * 8.0, level;
+	int k;
+
+	if (plan->packets == 0)
+		plan->start = plan->last = time;
+	if (time > plan->last) {
+		fill = (time - plan->last) / 1e6 * plan->maxrate;
+		plan->last = time;
+	}
+	++plan->packets;
+	plan->bits += bits;
+
+	for (k = 0; k < plan->limit; ++k) {
+		level = refill(plan, plan->level[k], fill) -
+		    bits * plan->scale[k];
+		if (level < 0) {
+			plan->limit = k;
+			break;
+		}
+		plan->level[k] = level;
+	}
+
+	/* Not done by the loop once it stops at or below it. */
+	if (plan->limit <= AS_IS)
+		plan->level[AS_IS] = refill(plan, plan->level[AS_IS], fill) -
+		    bits;
+
+	level = plan->level[AS_IS];
+	if (level < plan->lowest) {
+		plan->lowest = level;
+		plan->lowest_time = time - plan->start;
+	}
+	if (level < 0) {
+		if (plan->underflows++ == 0)
+			plan->first_underflow = time - plan->start;
+		plan->level[AS_IS] = 0;
+	}
+}
+
+/*
+ * The packets are taken to be evenly spaced, so the last one lasts as
+ * long as the average.
+ */
+static double
+plan_duration(const struct plan *plan)
+{
+	double span = (plan->last - plan->start) / 1e6;
+
+	return plan->packets > 1 ?
+	    span * plan->packets / (plan->packets - 1) : 1;
+}
+
+static void
+read_packets(struct plan *plan, FILE *fp, const char *name)
+{
+	static struct packet_reader pr;
+	struct packet pkt;
+
+	packet_init(&pr, fp);
+	while (packet_read(&pr, &pkt))
+		plan_packet(plan, pkt.has_dts ? pkt.dts : pkt.time, pkt.size);
+
+	if (ferror(fp)) {
+		perror(name);
+		exit(EXIT_FAILURE);
+	}
+	if (pr.skipped > 0)
+		fprintf(stderr, "%s: skipped %ld of %ld lines.\n", name,
+		    pr.skipped, pr.lines);
+}
+
+static void
+print_plan(const struct plan *plan)
+{
+	double duration = plan_duration(plan);
+	double rate = plan->bits / duration;
+
+	printf("packets     %ld\n", plan->packets);
+	printf("duration    %.1f s\n", duration);
+	printf("bitrate     %.0f kbit/s\n", rate / 1000);
+	printf("maxrate     %.0f kbit/s\n", plan->maxrate / 1000);
+	printf("buffer      %.0f kbit\n", plan->bufsize / 1000);
+	if (plan->underflows > 0)
+		printf("underflows  %ld, first at %.2f s\n",
+		    plan->underflows, plan->first_underflow / 1e6);
+	else
+		printf("underflows  0\n");
+	printf("lowest      %.0f kbit (%.0f%%) at %.2f s\n",
+	    plan->lowest / 1000, plan->lowest * 100 / plan->bufsize,
+	    plan->lowest_time / 1e6);
+
+	if (plan->limit == 0)
+		printf("safe rate   none\n");
+	else {
+		double safe = rate * plan->scale[plan->limit - 1];
+
+		if (safe > plan->maxrate)
+			safe = plan->maxrate;
+		printf("safe rate   %.0f kbit/s%s\n", floor(safe / 1000),
+		    plan->limit == NSCALES ? " or more" : "");
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: vbvplan [-c] [-b bufsize_k] [-m maxrate_k] "
+	    "[packets.csv]\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char **argv)
+{
+	static struct plan plan;
+	int maxrate = MAXRATE_K, bufsize = BUFSIZE_K;
+	int check = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "b:cm:")) != -1) {
+		switch (ch) {
+		case 'b':
+			bufsize = atoi(optarg);
+			break;
+		case 'c':
+			check = 1;
+			break;
+		case 'm':
+			maxrate = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1 || bufsize < 1 || maxrate < 1)
+		usage();
+
+	plan_init(&plan, maxrate, bufsize);
+	if (argc == 1) {
+		FILE *fp;
+
+		if ((fp = fopen(argv[0], "r")) == NULL) {
+			perror(argv[0]);
+			return EXIT_FAILURE;
+		}
+		read_packets(&plan, fp, argv[0]);
+		fclose(fp);
+	} else
+		read_packets(&plan, stdin, "stdin");
+
+	if (plan.packets == 0) {
+		fprintf(stderr, "no packets found.\n");
+		return EXIT_FAILURE;
+	}
+
+	print_plan(&plan);
+
+	return check && plan.underflows > 0 ? 1 : 0;
+}
@@ -4,53 +4,17 @@
 #include <ctype.h>
 
 #include <assert.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "stats.h"
 
 #define NTOP 10
 #define DEFAULT_SHIFT 10
 #define MAX_SHIFT (((int)sizeof(size_t) * 8) - 1)
 
-static void
-die(const char *message)
-{
-	fprintf(stderr, "%s\n", message);
-	exit(1);
-}
-
-static void *
-xmalloc(size_t size)
-{
-	void *ptr;
-
-	ptr = malloc(size);
-	if (ptr == NULL)
-		die("malloc: out of memory.");
-
-	return ptr;
-}
-
-static void *
-xcalloc(size_t nmemb, size_t size)
-{
-	void *ptr;
-
-	ptr = calloc(nmemb, size);
-	if (ptr == NULL)
-		die("calloc: out of memory.");
-
-	return ptr;
-}
-
-static void *
-xrealloc(void *ptr, size_t size)
-{
-	void *new_ptr;
-
-	new_ptr = realloc(ptr, size);
-	if (new_ptr == NULL)
-		die("realloc: out of memory.");
-
-	return new_ptr;
-}
+/* Keys compared in lookups and times the table grew, for the stats. */
+static unsigned long probes, resizes;
 
 #define FNV_OFFSET_BASIS ((size_t)2166136261UL)
 #define FNV_PRIME ((size_t)16777619UL)
@@ -74,26 +38,23 @@ struct hash_item {
 	struct hash_item *next;
 };
 
+/*
+ * Items and their keys live in an arena until the end, only a new word
+ * is copied.
+ */
 static struct hash_item *
-item_new(const char *key)
+item_new(struct arena *arena, const char *key, size_t len)
 {
 	struct hash_item *item;
 
-	item = xmalloc(sizeof(*item));
-	item->key = key;
+	item = arena_alloc(arena, sizeof(*item));
+	item->key = arena_strndup(arena, key, len);
 	item->value = 1;
 	item->next = NULL;
 
 	return item;
 }
 
-static void
-item_free(struct hash_item *item)
-{
-	free((void *)item->key);
-	free(item);
-}
-
 struct hash_table {
 	struct hash_item **items;
 	size_t nitems;
@@ -140,34 +101,22 @@ static struct hash_item *
 hash_table_get(struct hash_table *ht, const char *key)
 {
 	struct hash_item *item = NULL;
+	unsigned long n = 0;
 	size_t hash;
 
 	hash = hash_function(key) & (ht->size - 1);
 	item = ht->items[hash];
 
-	while (item != NULL && strcmp(item->key, key) != 0)
+	while (item != NULL && strcmp(item->key, key) != 0) {
 		item = item->next;
+		++n;
+	}
+	if (stats_enabled)
+		probes += n + (item != NULL);
 
 	return item;
 }
 
-static void
-hash_table_foreach(struct hash_table *ht, void (*fn)(struct hash_item *))
-{
-	size_t i;
-
-	for (i = 0; i < ht->size; ++i) {
-		struct hash_item *item = ht->items[i];
-
-		while (item != NULL) {
-			struct hash_item *next_item = item->next;
-
-			fn(item);
-			item = next_item;
-		}
-	}
-}
-
 static void
 hash_table_grow(struct hash_table **htpp)
 {
@@ -177,9 +126,7 @@ hash_table_grow(struct hash_table **htpp)
 
 	if ((ht->shift + 1) > MAX_SHIFT)
 		die("hash_table_grow: no room.");
-#if STATS
-	printf("--> grow hash_table to %d entries.\n", 1 << (ht->shift + 1));
-#endif
+	++resizes;
 
 	new_ht = hash_table_new(ht->shift + 1);
 	for (i = 0; i < ht->size; ++i) {
@@ -198,40 +145,31 @@ hash_table_grow(struct hash_table **htpp)
 	*htpp = new_ht;
 }
 
-#if STATS
-static void
-hash_table_statistics(struct hash_table *ht)
-{
-	printf("Hash table size is %lu kb.\n",
-	    (ht->size * sizeof(ht->items[0])) / 1024);
-}
-#endif
-
-static char *
-read_word(FILE *f)
+/*
+ * Read the next word, lowercased, into *word. Returns its length, 0
+ * for a character that is not a letter or -1 at the end of the input.
+ */
+static long
+read_word(struct reader *in, char **word, size_t *cap)
 {
-	size_t len = 0, cap = 0;
-	char *word = NULL;
+	size_t len = 0;
 	int ch;
 
-	while ((ch = fgetc(f)) != EOF && isalpha(ch)) {
-		ch = tolower(ch);
-
-		if (len >= cap) {
-			word = xrealloc(word, cap + 32);
-			cap += 32;
+	while ((ch = READ_BYTE(in)) != EOF && isalpha(ch)) {
+		if (len + 1 >= *cap) {
+			*cap += 32;
+			*word = xrealloc(*word, *cap);
 		}
 
-		word[len++] = ch;
+		(*word)[len++] = tolower(ch);
 	}
 
-	if (word == NULL && ch == EOF)
-		return NULL;
-
-	word = xrealloc(word, len + 1);
-	word[len] = '\0';
+	if (len == 0 && ch == EOF)
+		return -1;
+	if (len > 0)
+		(*word)[len] = '\0';
 
-	return word;
+	return len;
 }
 
 static int
@@ -292,7 +230,8 @@ show_topn(struct hash_table *ht, size_t n)
 }
 
 static void
-add_word(struct hash_table **htpp, const char *word)
+add_word(struct hash_table **htpp, struct arena *arena, const char *word,
+    size_t len)
 {
 	struct hash_table *ht = *htpp;
 	struct hash_item *item;
@@ -305,7 +244,7 @@ add_word(struct hash_table **htpp, const char *word)
 		if (ht->nitems > (ht->size / 4 * 3))
 			hash_table_grow(&ht);
 
-		hash_table_add(ht, item_new(word));
+		hash_table_add(ht, item_new(arena, word, len));
 
 		/* Propagate changes back to the caller. */
 		*htpp = ht;
@@ -316,26 +255,42 @@ int
 main(void)
 {
 	struct hash_table *wordcounts;
-	char *word;
+	struct arena arena;
+	struct reader in;
+	char *word = NULL;
+	size_t cap = 0;
+	unsigned long clock, nwords = 0;
+	long len;
+
+	stats_init("wordfreq", 0);
+	clock = stats_clock();
 
 	wordcounts = hash_table_new(DEFAULT_SHIFT);
+	arena_init(&arena);
+	reader_init(&in, STDIN_FILENO, "stdin");
 
-	while ((word = read_word(stdin)) != NULL) {
-		if (*word == '\0') {
-			free(word);
-			continue;
+	while ((len = read_word(&in, &word, &cap)) >= 0)
+		if (len > 0) {
+			add_word(&wordcounts, &arena, word, len);
+			++nwords;
 		}
 
-		add_word(&wordcounts, word);
-	}
-
-#if STATS
-	hash_table_statistics(wordcounts);
-#endif
+	if (reader_close(&in) != 0)
+		die("read: %s", strerror(in.error));
+	stats_lap("count", &clock);
 
 	show_topn(wordcounts, NTOP);
+	stats_lap("sort", &clock);
+
+	stats_count("bytes_read", in.nread);
+	stats_count("words", nwords);
+	stats_count("unique_words", wordcounts->nitems);
+	stats_count("probes", probes);
+	stats_count("resizes", resizes);
+	stats_count("buckets", wordcounts->size);
 
-	hash_table_foreach(wordcounts, item_free);
+	free(word);
+	arena_free(&arena);
 	hash_table_free(wordcounts);
 
 	return 0;